@@ -1,36 +1,71 @@
+import argparse
+import sqlite3
+
 import matplotlib.pyplot as plt
 import numpy as np
 import pandas as pd
 
-# Carrega os dados dos arquivos txt
-try:
-    latencies = np.loadtxt("output/latency.txt")
+# Fonte dos dados: por padrão os arquivos de output/; com --db, o banco SQLite gerado por sweep/run_sweep.py
+# (todas as execuções do cenário IoT, ou só as selecionadas por --where, ex.: --where "nSensors = '50'").
+parser = argparse.ArgumentParser(description="Gera os gráficos do cenário IoT")
+parser.add_argument("--db", help="banco SQLite de uma varredura (sweep/run_sweep.py)")
+parser.add_argument("--where", default="1", help="filtro SQL sobre a tabela runs")
+args = parser.parse_args()
+
+node_summary = None
+if args.db:
+    # Junta as execuções selecionadas: latências de todos os fluxos, mensagens/energia médias por nó
+    # e os eventos (se a varredura importou o logs.csv com --with-events).
+    con = sqlite3.connect(args.db)
+    selected = f"SELECT run_id FROM runs WHERE scenario = 'iot' AND status = 0 AND ({args.where})"
+    latencies = pd.read_sql(f"SELECT latency FROM iot_latency WHERE run_id IN ({selected})", con)["latency"].to_numpy()
     latencies = latencies[latencies < 1.0]  # Filtra latências improváveis
-except (ValueError, FileNotFoundError):
-    print("Erro ao carregar latency.txt ou dados inválidos. Usando valores padrão.")
-    latencies = np.array([0.0])
-
-try:
-    messages_sent = np.loadtxt("output/messages_sent.txt")
-except (ValueError, FileNotFoundError):
-    print("Erro ao carregar messages_sent.txt. Usando valores padrão.")
-    messages_sent = np.zeros(10)
-
-try:
-    energy_consumption = np.loadtxt("output/energy_consumption.txt")
-except (ValueError, FileNotFoundError):
-    print("Erro ao carregar energy_consumption.txt. Usando valores padrão.")
-    energy_consumption = np.zeros(10)
-
-# Carrega o arquivo logs.csv usando pandas
-try:
-    df = pd.read_csv("output/logs.csv")
-except FileNotFoundError:
-    print("Erro ao carregar logs.csv. Usando DataFrame vazio.")
-    df = pd.DataFrame(columns=["Timestamp", "NodeID", "Event", "Details"])
-
-# Define os IDs dos nós (0 a 9)
-nodes = np.arange(0, 10)
+    per_node = pd.read_sql(f"SELECT node_index, AVG(messages_sent) AS sent, AVG(energy) AS energy FROM iot_nodes "
+                           f"WHERE run_id IN ({selected}) GROUP BY node_index ORDER BY node_index", con)
+    messages_sent = per_node["sent"].to_numpy()
+    energy_consumption = per_node["energy"].to_numpy()
+    df = pd.read_sql(f"SELECT Timestamp, NodeID, Event, Details FROM iot_events WHERE run_id IN ({selected})", con)
+    con.close()
+    if len(latencies) == 0:
+        latencies = np.array([0.0])
+else:
+    # Carrega os dados dos arquivos txt
+    try:
+        latencies = np.loadtxt("output/latency.txt")
+        latencies = latencies[latencies < 1.0]  # Filtra latências improváveis
+    except (ValueError, FileNotFoundError):
+        print("Erro ao carregar latency.txt ou dados inválidos. Usando valores padrão.")
+        latencies = np.array([0.0])
+
+    try:
+        messages_sent = np.loadtxt("output/messages_sent.txt")
+    except (ValueError, FileNotFoundError):
+        print("Erro ao carregar messages_sent.txt. Usando valores padrão.")
+        messages_sent = np.zeros(10)
+
+    try:
+        energy_consumption = np.loadtxt("output/energy_consumption.txt")
+    except (ValueError, FileNotFoundError):
+        print("Erro ao carregar energy_consumption.txt. Usando valores padrão.")
+        energy_consumption = np.zeros(10)
+
+    # Resumo por nó do packets.bin (sweep/packet_summary.py, só em execuções com --packetTrace)
+    try:
+        node_summary = pd.read_csv("output/node_summary.csv")
+    except FileNotFoundError:
+        node_summary = None
+
+    # Carrega o arquivo logs.csv usando pandas
+    try:
+        df = pd.read_csv("output/logs.csv")
+    except FileNotFoundError:
+        print("Erro ao carregar logs.csv. Usando DataFrame vazio.")
+        df = pd.DataFrame(columns=["Timestamp", "NodeID", "Event", "Details"])
+
+# Define os índices dos sensores (um por linha de messages_sent.txt)
+messages_sent = np.atleast_1d(messages_sent)
+energy_consumption = np.atleast_1d(energy_consumption)
+nodes = np.arange(0, len(messages_sent))
 
 # Gráfico 1: Taxa de Envio de Pacotes ao Longo do Tempo
 # Filtra eventos de envio e arredonda os timestamps
@@ -147,4 +182,20 @@ if len(response_latencies) > 0:
     plt.savefig('output/response_latency_vs_messages.png')
     plt.close()
 else:
-    print("Não há latências de resposta suficientes para o gráfico de dispersão.")
\ No newline at end of file
+    print("Não há latências de resposta suficientes para o gráfico de dispersão.")
+
+# Gráfico 7: Percentis de Atraso por Nó de Origem (node_summary.csv do sweep/packet_summary.py)
+if node_summary is not None and not node_summary.empty:
+    width = 0.25
+    x = np.arange(len(node_summary))
+    plt.figure(figsize=(8, 6))
+    for i, column in enumerate(["P50Delay(ms)", "P90Delay(ms)", "P99Delay(ms)"]):
+        plt.bar(x + (i - 1) * width, node_summary[column], width, label=column.replace("Delay(ms)", ""))
+    plt.xticks(x, node_summary["NodeID"])
+    plt.title('Percentis de Atraso por Nó de Origem')
+    plt.xlabel('ID do Nó')
+    plt.ylabel('Atraso (ms)')
+    plt.grid(True)
+    plt.legend()
+    plt.savefig('output/delay_percentiles_per_node.png')
+    plt.close()
@@ -6,361 +6,3995 @@
 #include "ns3/mobility-module.h"      
 #include "ns3/applications-module.h"  
 #include "ns3/flow-monitor-module.h"  
+#include "ns3/energy-module.h"
+#include "ns3/spectrum-module.h"
+#include "ns3/propagation-module.h"
 #include <fstream>                 
 #include <cstring>                 
 #include <iomanip>                   
 #include <sstream>                    
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <deque>
+#include <limits>
+#include <typeindex>
+#include <unordered_map>
+#include <cxxabi.h>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../sweep/packet_trace.h"  // LatencyHistogram, LatencyTag e PacketTrace, comuns aos dois cenários.
 
 using namespace ns3;  // Usa o namespace ns3 para evitar prefixos longos como ns3::Simulator.
 
 // Define um componente de log para a classe MqttPublisher, permitindo logs detalhados no terminal.
 NS_LOG_COMPONENT_DEFINE("MqttPublisher");
 
-// Declara um arquivo de log global para o CSV, que será usado para salvar os logs da classe MqttPublisher.
-std::ofstream logCsvFile;
+// Tipos de evento registrados no log. Os nomes em texto (usados no logs.csv) ficam em EventTypeName().
+enum class EventType : uint8_t {
+    SENT_PACKET = 0,          // Sensor enviou uma publicação.
+    RECEIVED_PACKET = 1,      // Nó recebeu um pacote.
+    GATEWAY_RESPONSE = 2,     // Gateway respondeu (ACK) a um sensor.
+    REACHED_MAX_PACKETS = 3,  // Sensor atingiu o limite de pacotes.
+    PUBLISH_COMPLETED = 4,    // Publicação QoS 1/2 confirmada pelo broker (PUBACK/PUBCOMP).
+    MESSAGE_DELIVERED = 5,    // Assinante recebeu uma publicação repassada pelo broker.
+    RETRANSMISSION = 6,       // Mensagem MQTT-SN retransmitida por falta de confirmação.
+    MESSAGE_FAILED = 7,       // Mensagem MQTT-SN descartada após esgotar as retransmissões.
+    ENERGY_DEPLETED = 8,      // Bateria do sensor esgotada.
+};
+
+// Registro binário de largura fixa (32 bytes) gravado no events.bin.
+// O campo "payload" é interpretado de acordo com o tipo de evento.
+struct EventRecord {
+    int64_t timestampNs;  // Instante do evento em nanossegundos de tempo simulado.
+    uint32_t nodeId;      // ID do nó que gerou o evento.
+    uint8_t event;        // Valor de EventType.
+    uint8_t reserved[3];  // Alinhamento (sempre zero).
+    union {
+        struct {
+            uint32_t seq;         // Número do pacote enviado pelo sensor.
+            int32_t sendResult;   // Retorno de Socket::Send.
+            int16_t tempDeci;     // Temperatura em décimos de °C.
+            uint8_t humidity;     // Umidade relativa (%).
+            uint8_t pad;
+            uint16_t length;      // Tamanho da mensagem em bytes.
+            uint16_t pad2;
+        } sent;
+        struct {
+            uint32_t size;        // Tamanho do pacote recebido.
+        } received;
+        struct {
+            uint8_t address[16];  // Endereço IPv6 do sensor que recebeu o ACK.
+        } response;
+        struct {
+            uint32_t maxPackets;  // Limite de pacotes configurado.
+        } limit;
+        struct {
+            int64_t latencyNs;    // Latência até a confirmação/entrega (ns).
+            uint16_t msgId;       // MsgId MQTT-SN.
+            uint16_t topicId;     // TopicId MQTT-SN.
+            uint8_t msgType;      // Tipo da mensagem MQTT-SN.
+            uint8_t qos;          // Nível de QoS.
+            uint8_t attempt;      // Número da retransmissão.
+            uint8_t pad;
+        } mqtt;
+        struct {
+            double consumedJ;     // Energia consumida pelo rádio até o evento (J).
+        } energy;
+        uint8_t raw[16];
+    } payload;
+};
+static_assert(sizeof(EventRecord) == 32, "EventRecord deve ter 32 bytes");
+
+// Cabeçalho do arquivo events.bin, usado pelo conversor para validar o formato.
+struct EventLogHeader {
+    char magic[8];        // "SLPEVLOG"
+    uint32_t version;     // Versão do formato.
+    uint32_t recordSize;  // sizeof(EventRecord).
+};
+static const uint32_t EVENT_LOG_VERSION = 1;
+
+// Nome textual de cada evento, idêntico ao que o logs.csv sempre usou.
+const char* EventTypeName(uint8_t event) {
+    switch (static_cast<EventType>(event)) {
+        case EventType::SENT_PACKET: return "Sent Packet";
+        case EventType::RECEIVED_PACKET: return "Received Packet";
+        case EventType::GATEWAY_RESPONSE: return "Gateway Response";
+        case EventType::REACHED_MAX_PACKETS: return "Reached Max Packets";
+        case EventType::PUBLISH_COMPLETED: return "Publish Completed";
+        case EventType::MESSAGE_DELIVERED: return "Message Delivered";
+        case EventType::RETRANSMISSION: return "Retransmission";
+        case EventType::MESSAGE_FAILED: return "Message Failed";
+        case EventType::ENERGY_DEPLETED: return "Energy Depleted";
+    }
+    return "Unknown";
+}
+
+// Nome dos tipos de mensagem MQTT-SN usados nos detalhes do log.
+const char* MqttSnTypeName(uint8_t type);
+
+// Formata um registro como uma linha do logs.csv (Timestamp,NodeID,Event,"Details").
+// Usado pelo conversor pós-simulação e pelo modo legado "csv".
+void FormatCsvLine(const EventRecord& rec, std::ostream& os) {
+    char line[160];
+    int n = snprintf(line, sizeof(line), "%.6f,%u,%s,\"", rec.timestampNs / 1e9, rec.nodeId, EventTypeName(rec.event));
+    os.write(line, n);
+    switch (static_cast<EventType>(rec.event)) {
+        case EventType::SENT_PACKET:
+            n = snprintf(line, sizeof(line), "Packet: %u, Message: Temp: %.1f C, Hum: %u%%, Send Result: %d, Length: %u",
+                         rec.payload.sent.seq, rec.payload.sent.tempDeci / 10.0, rec.payload.sent.humidity,
+                         rec.payload.sent.sendResult, rec.payload.sent.length);
+            os.write(line, n);
+            break;
+        case EventType::RECEIVED_PACKET:
+            os << "Size: " << rec.payload.received.size;
+            break;
+        case EventType::GATEWAY_RESPONSE:
+            os << "To: " << Ipv6Address(const_cast<uint8_t*>(rec.payload.response.address));
+            break;
+        case EventType::REACHED_MAX_PACKETS:
+            os << "Max Packets: " << rec.payload.limit.maxPackets;
+            break;
+        case EventType::PUBLISH_COMPLETED:
+            n = snprintf(line, sizeof(line), "MsgId: %u, QoS: %u, Latency: %.6f", rec.payload.mqtt.msgId,
+                         rec.payload.mqtt.qos, rec.payload.mqtt.latencyNs / 1e9);
+            os.write(line, n);
+            break;
+        case EventType::MESSAGE_DELIVERED:
+            n = snprintf(line, sizeof(line), "TopicId: %u, MsgId: %u, QoS: %u, Latency: %.6f", rec.payload.mqtt.topicId,
+                         rec.payload.mqtt.msgId, rec.payload.mqtt.qos, rec.payload.mqtt.latencyNs / 1e9);
+            os.write(line, n);
+            break;
+        case EventType::RETRANSMISSION:
+            n = snprintf(line, sizeof(line), "Type: %s, MsgId: %u, Attempt: %u", MqttSnTypeName(rec.payload.mqtt.msgType),
+                         rec.payload.mqtt.msgId, rec.payload.mqtt.attempt);
+            os.write(line, n);
+            break;
+        case EventType::MESSAGE_FAILED:
+            n = snprintf(line, sizeof(line), "Type: %s, MsgId: %u", MqttSnTypeName(rec.payload.mqtt.msgType),
+                         rec.payload.mqtt.msgId);
+            os.write(line, n);
+            break;
+        case EventType::ENERGY_DEPLETED:
+            n = snprintf(line, sizeof(line), "Radio Energy: %.6f J", rec.payload.energy.consumedJ);
+            os.write(line, n);
+            break;
+    }
+    os << "\"\n";
+}
+
+// Log de eventos da simulação.
+// No modo "binary" (padrão) os registros são acumulados em um anel de blocos e um thread
+// escritor grava os blocos cheios no disco, sem formatação nem flush no caminho da simulação.
+// No modo "csv" cada evento é formatado e gravado com flush imediato (comportamento antigo),
+// útil para comparar o custo por evento entre os dois modos.
+class EventLog {
+public:
+    EventLog();
+    ~EventLog();
+    // Abre o log. blockRecords/blockCount definem o tamanho do anel (apenas no modo binário).
+    bool Open(const std::string& path, bool binary, uint32_t blockRecords, uint32_t blockCount);
+    // Adiciona um registro (chamado a partir dos eventos da simulação).
+    void Append(const EventRecord& rec);
+    // Esvazia o anel, encerra o thread escritor e fecha o arquivo.
+    void Close();
+    bool IsOpen() const { return m_open; }
+    bool IsBinary() const { return m_binary; }
+    const std::string& GetPath() const { return m_path; }
+    uint64_t GetEventCount() const { return m_events; }
+    uint64_t GetStallCount() const { return m_stalls; }
+    // Tempo médio (ns de relógio real) gasto dentro de Append por evento.
+    double GetNsPerEvent() const { return m_events ? static_cast<double>(m_appendNs) / m_events : 0.0; }
+private:
+    void WriterLoop();  // Laço do thread escritor.
+    void SubmitBlock();  // Entrega o bloco atual ao escritor e avança no anel.
+
+    std::string m_path;
+    bool m_open;
+    bool m_binary;
+    std::FILE* m_file;               // Arquivo binário (modo "binary").
+    std::ofstream m_csv;             // Arquivo texto (modo "csv").
+    std::vector<EventRecord> m_ring;  // blockCount blocos de blockRecords registros cada.
+    std::vector<uint32_t> m_used;    // Registros válidos em cada bloco entregue.
+    uint32_t m_blockRecords;
+    uint32_t m_blockCount;
+    uint32_t m_head;                 // Bloco sendo preenchido pela simulação.
+    uint32_t m_fill;                 // Registros já escritos no bloco m_head.
+    uint32_t m_tail;                 // Próximo bloco a ser gravado pelo escritor.
+    uint32_t m_pending;              // Blocos cheios aguardando o escritor.
+    bool m_closing;
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    uint64_t m_events;               // Eventos registrados.
+    uint64_t m_stalls;               // Vezes em que a simulação esperou o escritor (anel cheio).
+    uint64_t m_appendNs;             // Tempo acumulado dentro de Append.
+};
+
+EventLog::EventLog()
+    : m_open(false),
+      m_binary(true),
+      m_file(nullptr),
+      m_blockRecords(0),
+      m_blockCount(0),
+      m_head(0),
+      m_fill(0),
+      m_tail(0),
+      m_pending(0),
+      m_closing(false),
+      m_events(0),
+      m_stalls(0),
+      m_appendNs(0) {}
+
+EventLog::~EventLog() {
+    Close();
+}
+
+bool EventLog::Open(const std::string& path, bool binary, uint32_t blockRecords, uint32_t blockCount) {
+    m_path = path;
+    m_binary = binary;
+    if (!m_binary) {
+        // Modo legado: CSV texto com cabeçalho.
+        m_csv.open(path, std::ios::trunc);
+        if (!m_csv.is_open()) {
+            NS_LOG_ERROR("Failed to open " << path << " for writing");
+            return false;
+        }
+        m_csv << "Timestamp,NodeID,Event,Details\n";
+        m_open = true;
+        return true;
+    }
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        NS_LOG_ERROR("Failed to open " << path << " for writing");
+        return false;
+    }
+    EventLogHeader header;
+    std::memcpy(header.magic, "SLPEVLOG", sizeof(header.magic));
+    header.version = EVENT_LOG_VERSION;
+    header.recordSize = sizeof(EventRecord);
+    std::fwrite(&header, sizeof(header), 1, m_file);
+
+    // São necessários ao menos 2 blocos: um sendo preenchido e outro sendo gravado.
+    m_blockRecords = std::max<uint32_t>(blockRecords, 1);
+    m_blockCount = std::max<uint32_t>(blockCount, 2);
+    m_ring.assign(static_cast<size_t>(m_blockRecords) * m_blockCount, EventRecord());
+    m_used.assign(m_blockCount, 0);
+    m_head = m_fill = m_tail = m_pending = 0;
+    m_closing = false;
+    m_writer = std::thread(&EventLog::WriterLoop, this);
+    m_open = true;
+    return true;
+}
+
+void EventLog::Append(const EventRecord& rec) {
+    if (!m_open) {
+        NS_LOG_ERROR("Event log is not open for writing");
+        return;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    if (m_binary) {
+        m_ring[static_cast<size_t>(m_head) * m_blockRecords + m_fill] = rec;
+        if (++m_fill == m_blockRecords) {
+            SubmitBlock();
+        }
+    } else {
+        FormatCsvLine(rec, m_csv);
+        m_csv.flush();
+    }
+    m_events++;
+    m_appendNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void EventLog::SubmitBlock() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // O bloco m_head não pode ser reutilizado enquanto o escritor não liberar um bloco.
+    if (m_pending == m_blockCount - 1) {
+        m_stalls++;
+        m_cv.wait(lock, [this] { return m_pending < m_blockCount - 1; });
+    }
+    m_used[m_head] = m_fill;
+    m_pending++;
+    m_head = (m_head + 1) % m_blockCount;
+    m_fill = 0;
+    lock.unlock();
+    m_cv.notify_all();
+}
+
+void EventLog::WriterLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this] { return m_pending > 0 || m_closing; });
+        if (m_pending == 0) {
+            break;  // Encerrando e não há mais blocos pendentes.
+        }
+        uint32_t block = m_tail;
+        uint32_t used = m_used[block];
+        lock.unlock();
+        // Grava o bloco fora da região crítica; a simulação continua preenchendo outros blocos.
+        std::fwrite(&m_ring[static_cast<size_t>(block) * m_blockRecords], sizeof(EventRecord), used, m_file);
+        lock.lock();
+        m_tail = (m_tail + 1) % m_blockCount;
+        m_pending--;
+        m_cv.notify_all();
+    }
+}
+
+void EventLog::Close() {
+    if (!m_open) {
+        return;
+    }
+    if (m_binary) {
+        // Entrega o bloco parcialmente preenchido e aguarda o escritor esvaziar o anel.
+        if (m_fill > 0) {
+            SubmitBlock();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closing = true;
+        }
+        m_cv.notify_all();
+        m_writer.join();
+        std::fclose(m_file);
+        m_file = nullptr;
+    } else {
+        m_csv.close();
+    }
+    m_open = false;
+}
+
+// Converte um events.bin no esquema do logs.csv (Timestamp,NodeID,Event,Details),
+// mantendo o plot_metrics.py compatível. Executado após a simulação, fora do caminho crítico.
+bool ConvertEventLogToCsv(const std::string& binPath, const std::string& csvPath) {
+    std::FILE* in = std::fopen(binPath.c_str(), "rb");
+    if (!in) {
+        NS_LOG_ERROR("Failed to open " << binPath << " for reading");
+        return false;
+    }
+    EventLogHeader header;
+    if (std::fread(&header, sizeof(header), 1, in) != 1 ||
+        std::memcmp(header.magic, "SLPEVLOG", sizeof(header.magic)) != 0 ||
+        header.version != EVENT_LOG_VERSION || header.recordSize != sizeof(EventRecord)) {
+        NS_LOG_ERROR(binPath << " is not a valid event log");
+        std::fclose(in);
+        return false;
+    }
+    std::ofstream out(csvPath, std::ios::trunc);
+    if (!out.is_open()) {
+        NS_LOG_ERROR("Failed to open " << csvPath << " for writing");
+        std::fclose(in);
+        return false;
+    }
+    out << "Timestamp,NodeID,Event,Details\n";
+    std::vector<EventRecord> chunk(4096);
+    size_t n;
+    while ((n = std::fread(chunk.data(), sizeof(EventRecord), chunk.size(), in)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            FormatCsvLine(chunk[i], out);
+        }
+    }
+    std::fclose(in);
+    return true;
+}
+
+// Log global de eventos da simulação.
+EventLog eventLog;
+
+// Funções auxiliares para montar e registrar cada tipo de evento.
+EventRecord MakeEventRecord(uint32_t nodeId, EventType event) {
+    EventRecord rec;
+    std::memset(&rec, 0, sizeof(rec));
+    rec.timestampNs = Simulator::Now().GetNanoSeconds();
+    rec.nodeId = nodeId;
+    rec.event = static_cast<uint8_t>(event);
+    return rec;
+}
+
+void LogSentPacket(uint32_t nodeId, uint32_t seq, int16_t tempDeci, uint8_t hum, int sendResult, uint32_t length) {
+    EventRecord rec = MakeEventRecord(nodeId, EventType::SENT_PACKET);
+    rec.payload.sent.seq = seq;
+    rec.payload.sent.sendResult = sendResult;
+    rec.payload.sent.tempDeci = tempDeci;
+    rec.payload.sent.humidity = hum;
+    rec.payload.sent.length = static_cast<uint16_t>(length);
+    eventLog.Append(rec);
+}
+
+void LogReceivedPacket(uint32_t nodeId, uint32_t size) {
+    EventRecord rec = MakeEventRecord(nodeId, EventType::RECEIVED_PACKET);
+    rec.payload.received.size = size;
+    eventLog.Append(rec);
+}
+
+void LogGatewayResponse(uint32_t nodeId, Ipv6Address to) {
+    EventRecord rec = MakeEventRecord(nodeId, EventType::GATEWAY_RESPONSE);
+    to.GetBytes(rec.payload.response.address);
+    eventLog.Append(rec);
+}
+
+void LogReachedMaxPackets(uint32_t nodeId, uint32_t maxPackets) {
+    EventRecord rec = MakeEventRecord(nodeId, EventType::REACHED_MAX_PACKETS);
+    rec.payload.limit.maxPackets = maxPackets;
+    eventLog.Append(rec);
+}
+
+void LogEnergyDepleted(uint32_t nodeId, double consumedJ) {
+    EventRecord rec = MakeEventRecord(nodeId, EventType::ENERGY_DEPLETED);
+    rec.payload.energy.consumedJ = consumedJ;
+    eventLog.Append(rec);
+}
+
+// Registra um evento do protocolo MQTT-SN (confirmação, entrega, retransmissão ou falha).
+void LogMqttEvent(uint32_t nodeId, EventType event, uint8_t msgType, uint16_t msgId, uint16_t topicId,
+                  uint8_t qos, uint8_t attempt, Time latency) {
+    EventRecord rec = MakeEventRecord(nodeId, event);
+    rec.payload.mqtt.latencyNs = latency.GetNanoSeconds();
+    rec.payload.mqtt.msgId = msgId;
+    rec.payload.mqtt.topicId = topicId;
+    rec.payload.mqtt.msgType = msgType;
+    rec.payload.mqtt.qos = qos;
+    rec.payload.mqtt.attempt = attempt;
+    eventLog.Append(rec);
+}
+
+// Modelos de carga (intervalo entre publicações) dos sensores.
+enum class WorkloadModel {
+    UNIFORM,   // Intervalo uniforme entre minInterval e maxInterval, em passos de 0,1 s (modelo original).
+    PERIODIC,  // Intervalo fixo (period).
+    POISSON,   // Chegadas de Poisson: intervalo exponencial com média meanInterval.
+    ONOFF,     // Rajadas: períodos ON (exponencial, média onMean) com envios a cada burstInterval,
+               // separados por períodos OFF (exponencial, média offMean).
+    TRACE,     // Reprodução dos instantes de envio de um CSV de sensores reais.
+};
+
+// Série de intervalos (s) entre publicações consecutivas de um sensor real, compartilhada entre aplicações.
+typedef std::shared_ptr<const std::vector<double>> WorkloadTrace;
+
+// Parâmetros do modelo de carga, iguais para todos os sensores.
+struct WorkloadConfig {
+    WorkloadModel model = WorkloadModel::UNIFORM;
+    double minInterval = 0.5;    // UNIFORM: intervalo mínimo (s).
+    double maxInterval = 2.5;    // UNIFORM: intervalo máximo (s).
+    double period = 1.5;         // PERIODIC: período (s).
+    double meanInterval = 1.5;   // POISSON: intervalo médio (s).
+    double onMean = 2.0;         // ONOFF: duração média do período ON (s).
+    double offMean = 5.0;        // ONOFF: duração média do período OFF (s).
+    double burstInterval = 0.1;  // ONOFF: intervalo entre envios durante o ON (s).
+};
+
+// Converte o nome do modelo (linha de comando) em WorkloadModel.
+bool ParseWorkloadModel(const std::string& name, WorkloadModel& model) {
+    if (name == "uniform") { model = WorkloadModel::UNIFORM; return true; }
+    if (name == "periodic") { model = WorkloadModel::PERIODIC; return true; }
+    if (name == "poisson") { model = WorkloadModel::POISSON; return true; }
+    if (name == "onoff") { model = WorkloadModel::ONOFF; return true; }
+    if (name == "trace") { model = WorkloadModel::TRACE; return true; }
+    return false;
+}
+
+// Carrega um CSV de instantes de envio de sensores reais, no formato "sensor,timestamp" (segundos),
+// com cabeçalho opcional. Arquivos com uma única coluna são tratados como um único sensor.
+// Retorna uma série de intervalos por sensor, na ordem em que os sensores aparecem no arquivo.
+std::vector<WorkloadTrace> LoadWorkloadTrace(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        NS_LOG_ERROR("Failed to open workload trace " << path);
+        return {};
+    }
+    std::vector<std::string> ids;  // Sensores na ordem de aparição.
+    std::map<std::string, std::vector<double>> timestamps;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string id = "0";
+        std::string value = line;
+        size_t comma = line.find(',');
+        if (comma != std::string::npos) {
+            id = line.substr(0, comma);
+            value = line.substr(comma + 1);
+        }
+        char* end = nullptr;
+        double t = std::strtod(value.c_str(), &end);
+        if (end == value.c_str()) {
+            continue;  // Cabeçalho ou linha inválida.
+        }
+        auto it = timestamps.find(id);
+        if (it == timestamps.end()) {
+            ids.push_back(id);
+            it = timestamps.emplace(id, std::vector<double>()).first;
+        }
+        it->second.push_back(t);
+    }
+    std::vector<WorkloadTrace> traces;
+    for (const std::string& id : ids) {
+        std::vector<double>& ts = timestamps[id];
+        std::sort(ts.begin(), ts.end());
+        auto gaps = std::make_shared<std::vector<double>>();
+        gaps->reserve(ts.size());
+        for (size_t i = 1; i < ts.size(); ++i) {
+            gaps->push_back(ts[i] - ts[i - 1]);
+        }
+        traces.push_back(gaps);
+    }
+    return traces;
+}
+
+// Taxa média (aproximada) de publicações por segundo de um sensor com o modelo de carga.
+double WorkloadRate(const WorkloadConfig& workload, const WorkloadTrace& trace) {
+    switch (workload.model) {
+        case WorkloadModel::UNIFORM:
+            return 2.0 / (workload.minInterval + std::max(workload.minInterval, workload.maxInterval));
+        case WorkloadModel::PERIODIC:
+            return 1.0 / workload.period;
+        case WorkloadModel::POISSON:
+            return 1.0 / workload.meanInterval;
+        case WorkloadModel::ONOFF:
+            return workload.onMean / (workload.onMean + workload.offMean) / workload.burstInterval;
+        case WorkloadModel::TRACE: {
+            if (!trace) {
+                return 0.0;
+            }
+            double total = 0.0;
+            for (double gap : *trace) {
+                total += gap;
+            }
+            return total > 0 ? trace->size() / total : 0.0;
+        }
+    }
+    return 0.0;
+}
+
+// Como os sensores de uma PAN com vários gateways escolhem o seu broker.
+enum class GatewayAssignment {
+    HASH,        // Hash do ID do nó módulo o número de gateways.
+    LEAST_LOAD,  // Gateway com a menor taxa esperada já atribuída (WorkloadRate dos sensores).
+};
+
+bool ParseGatewayAssignment(const std::string& name, GatewayAssignment& assignment) {
+    if (name == "hash") { assignment = GatewayAssignment::HASH; return true; }
+    if (name == "leastload") { assignment = GatewayAssignment::LEAST_LOAD; return true; }
+    return false;
+}
+
+// Finalizador de 32 bits do MurmurHash3: espalha IDs consecutivos entre os gateways.
+uint32_t GatewayHash(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
+// Tipos de mensagem MQTT-SN (v1.2) usados na simulação.
+enum MqttSnMsgType : uint8_t {
+    MQTTSN_REGISTER = 0x0A,
+    MQTTSN_REGACK = 0x0B,
+    MQTTSN_PUBLISH = 0x0C,
+    MQTTSN_PUBACK = 0x0D,
+    MQTTSN_PUBCOMP = 0x0E,
+    MQTTSN_PUBREC = 0x0F,
+    MQTTSN_PUBREL = 0x10,
+    MQTTSN_SUBSCRIBE = 0x12,
+    MQTTSN_SUBACK = 0x13,
+};
+static const uint8_t MQTTSN_FLAG_DUP = 0x80;  // Bit DUP do campo Flags (retransmissões).
+static const uint8_t MQTTSN_RC_ACCEPTED = 0x00;  // Return code: aceito.
+static const uint8_t MQTTSN_RC_CONGESTION = 0x01;  // Return code: rejeitado por congestionamento.
+static const uint8_t MQTTSN_RC_INVALID_TOPIC = 0x02;  // Return code: TopicId inválido.
+
+const char* MqttSnTypeName(uint8_t type) {
+    switch (type) {
+        case MQTTSN_REGISTER: return "REGISTER";
+        case MQTTSN_REGACK: return "REGACK";
+        case MQTTSN_PUBLISH: return "PUBLISH";
+        case MQTTSN_PUBACK: return "PUBACK";
+        case MQTTSN_PUBCOMP: return "PUBCOMP";
+        case MQTTSN_PUBREC: return "PUBREC";
+        case MQTTSN_PUBREL: return "PUBREL";
+        case MQTTSN_SUBSCRIBE: return "SUBSCRIBE";
+        case MQTTSN_SUBACK: return "SUBACK";
+    }
+    return "UNKNOWN";
+}
+
+// Campos de uma mensagem MQTT-SN. "data" aponta, sem cópia, para o conteúdo da publicação
+// (PUBLISH) ou para o nome do tópico (REGISTER, SUBSCRIBE).
+struct MqttSnMessage {
+    uint8_t type = 0;
+    uint8_t flags = 0;  // PUBLISH, SUBSCRIBE e SUBACK: DUP (bit 7) e QoS (bits 5-6).
+    uint16_t topicId = 0;
+    uint16_t msgId = 0;
+    uint8_t returnCode = 0;
+    const uint8_t* data = nullptr;
+    uint32_t dataLength = 0;
+
+    uint8_t GetQos() const { return (flags >> 5) & 0x03; }
+    void SetQos(uint8_t qos) { flags = static_cast<uint8_t>((flags & ~0x60) | ((qos & 0x03) << 5)); }
+};
+
+// Tamanho da mensagem sem o campo Length (MsgType + campos variáveis + dados).
+uint32_t MqttSnBodySize(const MqttSnMessage& msg) {
+    switch (msg.type) {
+        case MQTTSN_REGISTER: return 1 + 2 + 2 + msg.dataLength;        // TopicId, MsgId, TopicName
+        case MQTTSN_REGACK: return 1 + 2 + 2 + 1;                       // TopicId, MsgId, ReturnCode
+        case MQTTSN_PUBLISH: return 1 + 1 + 2 + 2 + msg.dataLength;     // Flags, TopicId, MsgId, Data
+        case MQTTSN_PUBACK: return 1 + 2 + 2 + 1;                       // TopicId, MsgId, ReturnCode
+        case MQTTSN_PUBCOMP:
+        case MQTTSN_PUBREC:
+        case MQTTSN_PUBREL: return 1 + 2;                               // MsgId
+        case MQTTSN_SUBSCRIBE: return 1 + 1 + 2 + msg.dataLength;       // Flags, MsgId, TopicName
+        case MQTTSN_SUBACK: return 1 + 1 + 2 + 2 + 1;                   // Flags, TopicId, MsgId, ReturnCode
+    }
+    return 0;
+}
+
+// Tamanho do campo Length: 1 byte até 255 bytes de mensagem, senão 3 bytes (0x01 + 2 bytes).
+uint32_t MqttSnLengthFieldSize(uint32_t bodySize) {
+    return bodySize + 1 <= 255 ? 1 : 3;
+}
+
+// Codifica msg em buffer. Retorna o tamanho total da mensagem, ou 0 se não couber em size.
+uint32_t EncodeMqttSn(const MqttSnMessage& msg, uint8_t* buffer, uint32_t size) {
+    uint32_t body = MqttSnBodySize(msg);
+    uint32_t lengthField = MqttSnLengthFieldSize(body);
+    uint32_t total = lengthField + body;
+    if (body == 0 || total > size || total > 0xFFFF) {
+        return 0;
+    }
+    uint8_t* p = buffer;
+    if (lengthField == 1) {
+        *p++ = static_cast<uint8_t>(total);
+    } else {
+        *p++ = 0x01;
+        *p++ = static_cast<uint8_t>(total >> 8);
+        *p++ = static_cast<uint8_t>(total);
+    }
+    auto writeU16 = [&p](uint16_t v) {
+        *p++ = static_cast<uint8_t>(v >> 8);
+        *p++ = static_cast<uint8_t>(v);
+    };
+    *p++ = msg.type;
+    switch (msg.type) {
+        case MQTTSN_REGISTER:
+            writeU16(msg.topicId);
+            writeU16(msg.msgId);
+            break;
+        case MQTTSN_REGACK:
+        case MQTTSN_PUBACK:
+            writeU16(msg.topicId);
+            writeU16(msg.msgId);
+            *p++ = msg.returnCode;
+            break;
+        case MQTTSN_PUBLISH:
+            *p++ = msg.flags;
+            writeU16(msg.topicId);
+            writeU16(msg.msgId);
+            break;
+        case MQTTSN_PUBCOMP:
+        case MQTTSN_PUBREC:
+        case MQTTSN_PUBREL:
+            writeU16(msg.msgId);
+            break;
+        case MQTTSN_SUBSCRIBE:
+            *p++ = msg.flags;
+            writeU16(msg.msgId);
+            break;
+        case MQTTSN_SUBACK:
+            *p++ = msg.flags;
+            writeU16(msg.topicId);
+            writeU16(msg.msgId);
+            *p++ = msg.returnCode;
+            break;
+    }
+    if (msg.dataLength > 0) {
+        std::memcpy(p, msg.data, msg.dataLength);
+    }
+    return total;
+}
+
+// Decodifica uma mensagem de buffer (msg.data passa a apontar para dentro de buffer).
+// Retorna false se a mensagem estiver truncada ou for de um tipo não suportado.
+bool DecodeMqttSn(const uint8_t* buffer, uint32_t length, MqttSnMessage& msg) {
+    if (length < 2) {
+        return false;
+    }
+    uint32_t offset = 1;
+    uint32_t total = buffer[0];
+    if (buffer[0] == 0x01) {
+        if (length < 4) {
+            return false;
+        }
+        total = (static_cast<uint32_t>(buffer[1]) << 8) | buffer[2];
+        offset = 3;
+    }
+    if (total > length || total <= offset) {
+        return false;
+    }
+    const uint8_t* p = buffer + offset;
+    const uint8_t* end = buffer + total;
+    auto readU16 = [&p]() {
+        uint16_t v = static_cast<uint16_t>((p[0] << 8) | p[1]);
+        p += 2;
+        return v;
+    };
+    msg = MqttSnMessage();
+    msg.type = *p++;
+    MqttSnMessage sizing;
+    sizing.type = msg.type;
+    if (MqttSnBodySize(sizing) == 0 || static_cast<uint32_t>(end - p) + 1 < MqttSnBodySize(sizing)) {
+        return false;
+    }
+    switch (msg.type) {
+        case MQTTSN_REGISTER:
+            msg.topicId = readU16();
+            msg.msgId = readU16();
+            break;
+        case MQTTSN_REGACK:
+        case MQTTSN_PUBACK:
+            msg.topicId = readU16();
+            msg.msgId = readU16();
+            msg.returnCode = *p++;
+            break;
+        case MQTTSN_PUBLISH:
+            msg.flags = *p++;
+            msg.topicId = readU16();
+            msg.msgId = readU16();
+            break;
+        case MQTTSN_PUBCOMP:
+        case MQTTSN_PUBREC:
+        case MQTTSN_PUBREL:
+            msg.msgId = readU16();
+            break;
+        case MQTTSN_SUBSCRIBE:
+            msg.flags = *p++;
+            msg.msgId = readU16();
+            break;
+        case MQTTSN_SUBACK:
+            msg.flags = *p++;
+            msg.topicId = readU16();
+            msg.msgId = readU16();
+            msg.returnCode = *p++;
+            break;
+    }
+    msg.data = p;
+    msg.dataLength = static_cast<uint32_t>(end - p);
+    return true;
+}
+
+// Formato do conteúdo das publicações dos sensores.
+enum class PayloadFormat {
+    BINARY,  // Leitura codificada em SENSOR_PAYLOAD_SIZE bytes (padrão).
+    TEXT,    // Texto legado "Temp: xx.x C, Hum: yy%".
+};
+
+// Converte o nome de um formato (--payload) para PayloadFormat. Retorna false se o nome for desconhecido.
+bool ParsePayloadFormat(const std::string& name, PayloadFormat& format) {
+    if (name == "binary") format = PayloadFormat::BINARY;
+    else if (name == "text") format = PayloadFormat::TEXT;
+    else return false;
+    return true;
+}
+
+static const uint8_t SENSOR_PAYLOAD_VERSION = 1;
+static const uint32_t SENSOR_PAYLOAD_SIZE = 8;  // Versão, sequência, temperatura e umidade.
+static const uint32_t SENSOR_PAYLOAD_MAX = 32;  // Maior conteúdo entre os formatos (texto).
+
+// Codifica uma leitura em buffer (pelo menos SENSOR_PAYLOAD_MAX bytes) e retorna o tamanho.
+// Binário: versão (1 byte), sequência (4 bytes), temperatura em décimos de °C (2 bytes, com sinal)
+// e umidade em % (1 byte), em big-endian como os campos do MQTT-SN.
+uint32_t EncodeSensorPayload(PayloadFormat format, uint32_t seq, int16_t tempDeci, uint8_t hum, uint8_t* buffer) {
+    if (format == PayloadFormat::TEXT) {
+        int magnitude = std::abs(static_cast<int>(tempDeci));
+        int length = snprintf(reinterpret_cast<char*>(buffer), SENSOR_PAYLOAD_MAX, "Temp: %s%d.%d C, Hum: %u%%",
+                              tempDeci < 0 ? "-" : "", magnitude / 10, magnitude % 10, static_cast<unsigned>(hum));
+        return std::min<uint32_t>(length, SENSOR_PAYLOAD_MAX - 1);
+    }
+    buffer[0] = SENSOR_PAYLOAD_VERSION;
+    buffer[1] = static_cast<uint8_t>(seq >> 24);
+    buffer[2] = static_cast<uint8_t>(seq >> 16);
+    buffer[3] = static_cast<uint8_t>(seq >> 8);
+    buffer[4] = static_cast<uint8_t>(seq);
+    buffer[5] = static_cast<uint8_t>(static_cast<uint16_t>(tempDeci) >> 8);
+    buffer[6] = static_cast<uint8_t>(tempDeci);
+    buffer[7] = hum;
+    return SENSOR_PAYLOAD_SIZE;
+}
+
+// Verifica se um nome de tópico casa com um filtro de assinatura ('+' = um nível, '#' = o restante).
+bool MqttTopicMatches(const std::string& filter, const std::string& topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        size_t fEnd = filter.find('/', f);
+        size_t tEnd = topic.find('/', t);
+        if (fEnd == std::string::npos) fEnd = filter.size();
+        if (tEnd == std::string::npos) tEnd = topic.size();
+        if (t > topic.size()) {
+            return false;
+        }
+        if (!(fEnd - f == 1 && filter[f] == '+') && filter.compare(f, fEnd - f, topic, t, tEnd - t) != 0) {
+            return false;
+        }
+        f = fEnd + 1;
+        t = tEnd + 1;
+    }
+    return t > topic.size();
+}
+
+// Tag com o instante da publicação original, usada para medir a latência fim a fim
+// (publicador -> broker -> assinante) sem ocupar bytes no quadro.
+class PublishTimeTag : public Tag {
+public:
+    static TypeId GetTypeId();
+    TypeId GetInstanceTypeId() const override { return GetTypeId(); }
+    uint32_t GetSerializedSize() const override { return 8; }
+    void Serialize(TagBuffer i) const override { i.WriteU64(static_cast<uint64_t>(m_time.GetTimeStep())); }
+    void Deserialize(TagBuffer i) override { m_time = TimeStep(i.ReadU64()); }
+    void Print(std::ostream& os) const override { os << "PublishTime=" << m_time; }
+    void SetTime(Time time) { m_time = time; }
+    Time GetTime() const { return m_time; }
+private:
+    Time m_time;
+};
+
+TypeId PublishTimeTag::GetTypeId() {
+    static TypeId tid = TypeId("PublishTimeTag").SetParent<Tag>().AddConstructor<PublishTimeTag>();
+    return tid;
+}
+
+NS_OBJECT_ENSURE_REGISTERED(PublishTimeTag);
+
+// Base comum dos participantes MQTT-SN (publicador, assinante e broker): socket UDP, codificação
+// das mensagens e o estado das mensagens confirmadas (REGISTER, SUBSCRIBE, PUBLISH QoS 1/2 e PUBREL),
+// retransmitidas até a confirmação ou até esgotar as tentativas.
+class MqttSnEndpoint : public Application {
+public:
+    MqttSnEndpoint();
+    virtual ~MqttSnEndpoint();
+    // Tempo de espera por uma confirmação e número máximo de retransmissões.
+    void SetRetransmission(Time timeout, uint32_t maxRetries);
+    // Espera antes de reenviar uma mensagem rejeitada pelo broker por congestionamento (T_WAIT).
+    void SetCongestionWait(Time wait) { m_congestionWait = wait; }
+    uint32_t GetNodeId() const { return m_nodeId; }
+    uint32_t GetPacketsReceived() const { return m_packetsReceived; }
+    uint64_t GetMessagesSent() const { return m_messagesSent; }
+    uint64_t GetBytesSent() const { return m_bytesSent; }
+    uint64_t GetPayloadBytesSent() const { return m_payloadBytesSent; }
+    uint64_t GetRetransmissions() const { return m_retransmissions; }
+    uint64_t GetCongestionRejects() const { return m_congestionRejects; }
+protected:
+    // Cria o socket UDP (port 0 = porta efêmera). Retorna false em caso de erro.
+    bool OpenSocket(uint16_t port);
+    // Cancela as mensagens pendentes e fecha o socket.
+    void CloseSocket();
+    // Envia uma mensagem sem aguardar confirmação. Retorna o resultado de Socket::SendTo.
+    int SendMessage(const MqttSnMessage& msg, const Address& to, Time publishTime = Time());
+    // Envia uma mensagem que aguarda a confirmação expectedAck, retransmitindo-a após m_retryTimeout.
+    // firstSent é a referência para a latência reportada em OnConfirmed; origin é o tipo reportado
+    // (PUBLISH também para o PUBREL da segunda fase do QoS 2).
+    int SendConfirmed(const MqttSnMessage& msg, uint8_t expectedAck, const Address& to, Time firstSent,
+                      Time publishTime, uint8_t origin);
+    // Trata confirmações (REGACK, SUBACK, PUBACK, PUBREC, PUBCOMP). No PUBREC envia o PUBREL.
+    // Uma confirmação com MQTTSN_RC_CONGESTION adia o reenvio da mensagem por m_congestionWait,
+    // sem gastar retransmissões. Retorna true se msg era uma confirmação.
+    bool HandleAck(const MqttSnMessage& msg, const Address& from);
+    // Aplica o QoS a um PUBLISH recebido (responde PUBACK ou PUBREC). Retorna true se a publicação
+    // deve ser entregue e false para duplicatas de QoS 2 já entregues.
+    bool AcceptPublish(const MqttSnMessage& msg, const Address& from);
+    // Trata um PUBREL (QoS 2): libera o MsgId recebido e responde PUBCOMP.
+    void HandlePubrel(const MqttSnMessage& msg, const Address& from);
+    // Próximo MsgId (nunca 0).
+    uint16_t NextMsgId();
+    // Entrega um pacote recebido: decodifica e chama HandleMessage.
+    void DispatchPacket(Ptr<Packet> packet, Address from);
+    // Ponto de entrada dos pacotes recebidos; por padrão chama DispatchPacket imediatamente.
+    virtual void ReceivePacket(Ptr<Packet> packet, const Address& from);
+    // Processa uma mensagem decodificada.
+    virtual void HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) = 0;
+    // Chamado quando uma mensagem confirmada é concluída, com a latência desde firstSent.
+    virtual void OnConfirmed(uint8_t origin, const MqttSnMessage& ack, Time latency) {}
+    // Chamado quando uma mensagem confirmada esgota as retransmissões.
+    virtual void OnFailed(uint8_t origin, uint16_t msgId) {}
+    // Chamado antes de cada transmissão (inclusive retransmissões).
+    virtual void OnTransmit() {}
+    // Chamado quando o broker rejeita uma mensagem por congestionamento.
+    virtual void OnCongestion(uint8_t origin) {}
+
+    Ptr<Socket> m_socket;  // Socket UDP do participante.
+    uint32_t m_nodeId;  // ID global do nó.
+    uint32_t m_packetsReceived;  // Mensagens recebidas.
+    Time m_congestionWait;  // Espera após uma rejeição por congestionamento.
+private:
+    // Mensagem confirmada aguardando resposta.
+    struct Pending {
+        Ptr<Packet> packet;  // Pacote transmitido (reenviado com o bit DUP nas retransmissões de PUBLISH).
+        Address to;
+        uint8_t type;  // Tipo da mensagem enviada.
+        uint8_t origin;  // Tipo reportado em OnConfirmed/OnFailed.
+        uint8_t expectedAck;
+        uint32_t retries;
+        Time firstSent;
+        Time publishTime;
+        EventId timer;
+    };
+    void HandleRead(Ptr<Socket> socket);
+    void Retransmit(uint16_t msgId);
+    // Reenvia uma mensagem rejeitada por congestionamento, após m_congestionWait.
+    void Resend(uint16_t msgId);
+    // Envia bytes já codificados, anexando a PublishTimeTag se houver.
+    int Transmit(Ptr<Packet> packet, const Address& to, Time publishTime);
+
+    Time m_retryTimeout;  // Tempo de espera por uma confirmação.
+    uint32_t m_maxRetries;  // Retransmissões antes de desistir.
+    uint16_t m_nextMsgId;
+    std::map<uint16_t, Pending> m_pending;  // Mensagens confirmadas em andamento, por MsgId.
+    std::set<std::pair<Address, uint16_t>> m_qos2Received;  // PUBLISH QoS 2 recebidos aguardando PUBREL.
+    std::vector<uint8_t> m_txBuffer;  // Buffer de codificação reutilizado.
+    std::vector<uint8_t> m_rxBuffer;  // Buffer de recepção reutilizado.
+    uint64_t m_messagesSent;
+    uint64_t m_bytesSent;  // Bytes MQTT-SN enviados (cabeçalhos + dados).
+    uint64_t m_payloadBytesSent;  // Bytes de dados de PUBLISH enviados.
+    uint64_t m_retransmissions;
+    uint64_t m_congestionRejects;  // Mensagens rejeitadas pelo broker por congestionamento.
+};
+
+MqttSnEndpoint::MqttSnEndpoint()
+    : m_socket(0),
+      m_nodeId(0),
+      m_packetsReceived(0),
+      m_congestionWait(Seconds(2.0)),
+      m_retryTimeout(Seconds(1.0)),
+      m_maxRetries(3),
+      m_nextMsgId(0),
+      m_txBuffer(512),
+      m_messagesSent(0),
+      m_bytesSent(0),
+      m_payloadBytesSent(0),
+      m_retransmissions(0),
+      m_congestionRejects(0) {}
+
+MqttSnEndpoint::~MqttSnEndpoint() {
+    m_socket = 0;
+}
+
+void MqttSnEndpoint::SetRetransmission(Time timeout, uint32_t maxRetries) {
+    m_retryTimeout = timeout;
+    m_maxRetries = maxRetries;
+}
+
+bool MqttSnEndpoint::OpenSocket(uint16_t port) {
+    m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+    int result = port ? m_socket->Bind(Inet6SocketAddress(Ipv6Address::GetAny(), port)) : m_socket->Bind6();
+    if (result == -1) {
+        NS_LOG_ERROR("Node " << m_nodeId << " failed to bind socket to port " << port);
+        return false;
+    }
+    m_socket->SetRecvCallback(MakeCallback(&MqttSnEndpoint::HandleRead, this));
+    return true;
+}
+
+void MqttSnEndpoint::CloseSocket() {
+    for (auto& entry : m_pending) {
+        Simulator::Cancel(entry.second.timer);
+    }
+    m_pending.clear();
+    if (m_socket) {
+        m_socket->Close();
+        m_socket = 0;
+    }
+}
+
+uint16_t MqttSnEndpoint::NextMsgId() {
+    if (++m_nextMsgId == 0) {
+        m_nextMsgId = 1;
+    }
+    return m_nextMsgId;
+}
+
+int MqttSnEndpoint::Transmit(Ptr<Packet> packet, const Address& to, Time publishTime) {
+    OnTransmit();
+    if (!publishTime.IsZero()) {
+        PublishTimeTag tag;
+        tag.SetTime(publishTime);
+        packet->ReplacePacketTag(tag);
+    }
+    m_messagesSent++;
+    m_bytesSent += packet->GetSize();
+    return m_socket->SendTo(packet, 0, to);
+}
+
+int MqttSnEndpoint::SendMessage(const MqttSnMessage& msg, const Address& to, Time publishTime) {
+    uint32_t length = EncodeMqttSn(msg, m_txBuffer.data(), m_txBuffer.size());
+    if (length == 0 || !m_socket) {
+        NS_LOG_ERROR("Node " << m_nodeId << " failed to encode " << MqttSnTypeName(msg.type));
+        return -1;
+    }
+    if (msg.type == MQTTSN_PUBLISH) {
+        m_payloadBytesSent += msg.dataLength;
+    }
+    return Transmit(Create<Packet>(m_txBuffer.data(), length), to, publishTime);
+}
+
+int MqttSnEndpoint::SendConfirmed(const MqttSnMessage& msg, uint8_t expectedAck, const Address& to, Time firstSent,
+                                  Time publishTime, uint8_t origin) {
+    uint32_t length = EncodeMqttSn(msg, m_txBuffer.data(), m_txBuffer.size());
+    if (length == 0 || !m_socket) {
+        NS_LOG_ERROR("Node " << m_nodeId << " failed to encode " << MqttSnTypeName(msg.type));
+        return -1;
+    }
+    if (msg.type == MQTTSN_PUBLISH) {
+        m_payloadBytesSent += msg.dataLength;
+    }
+    Pending& pending = m_pending[msg.msgId];
+    Simulator::Cancel(pending.timer);  // MsgId reutilizado após dar a volta.
+    pending.packet = Create<Packet>(m_txBuffer.data(), length);
+    pending.to = to;
+    pending.type = msg.type;
+    pending.origin = origin;
+    pending.expectedAck = expectedAck;
+    pending.retries = 0;
+    pending.firstSent = firstSent;
+    pending.publishTime = publishTime;
+    pending.timer = Simulator::Schedule(m_retryTimeout, &MqttSnEndpoint::Retransmit, this, msg.msgId);
+    return Transmit(pending.packet->Copy(), to, publishTime);
+}
+
+void MqttSnEndpoint::Retransmit(uint16_t msgId) {
+    auto it = m_pending.find(msgId);
+    if (it == m_pending.end()) {
+        return;
+    }
+    Pending& pending = it->second;
+    if (pending.retries >= m_maxRetries) {
+        LogMqttEvent(m_nodeId, EventType::MESSAGE_FAILED, pending.type, msgId, 0, 0, pending.retries, Time());
+        uint8_t origin = pending.origin;
+        m_pending.erase(it);
+        OnFailed(origin, msgId);
+        return;
+    }
+    pending.retries++;
+    m_retransmissions++;
+    Ptr<Packet> packet = pending.packet->Copy();
+    if (pending.type == MQTTSN_PUBLISH) {
+        // Marca a retransmissão com o bit DUP (byte de Flags logo após Length e MsgType).
+        uint32_t size = packet->GetSize();
+        packet->CopyData(m_txBuffer.data(), size);
+        m_txBuffer[(m_txBuffer[0] == 0x01 ? 3 : 1) + 1] |= MQTTSN_FLAG_DUP;
+        packet = Create<Packet>(m_txBuffer.data(), size);
+    }
+    LogMqttEvent(m_nodeId, EventType::RETRANSMISSION, pending.type, msgId, 0, 0, pending.retries, Time());
+    pending.timer = Simulator::Schedule(m_retryTimeout, &MqttSnEndpoint::Retransmit, this, msgId);
+    Transmit(packet, pending.to, pending.publishTime);
+}
+
+void MqttSnEndpoint::Resend(uint16_t msgId) {
+    auto it = m_pending.find(msgId);
+    if (it == m_pending.end()) {
+        return;
+    }
+    Pending& pending = it->second;
+    pending.timer = Simulator::Schedule(m_retryTimeout, &MqttSnEndpoint::Retransmit, this, msgId);
+    Transmit(pending.packet->Copy(), pending.to, pending.publishTime);
+}
+
+bool MqttSnEndpoint::HandleAck(const MqttSnMessage& msg, const Address& from) {
+    if (msg.type != MQTTSN_REGACK && msg.type != MQTTSN_SUBACK && msg.type != MQTTSN_PUBACK &&
+        msg.type != MQTTSN_PUBREC && msg.type != MQTTSN_PUBCOMP) {
+        return false;
+    }
+    auto it = m_pending.find(msg.msgId);
+    if (msg.returnCode == MQTTSN_RC_CONGESTION && msg.type != MQTTSN_PUBREC && msg.type != MQTTSN_PUBCOMP) {
+        // Rejeição por congestionamento (REGACK, SUBACK ou PUBACK, também para PUBLISH QoS 2):
+        // a mensagem continua pendente e é reenviada após a espera.
+        if (it != m_pending.end() && it->second.type != MQTTSN_PUBREL) {
+            m_congestionRejects++;
+            Simulator::Cancel(it->second.timer);
+            it->second.timer = Simulator::Schedule(m_congestionWait, &MqttSnEndpoint::Resend, this, msg.msgId);
+            OnCongestion(it->second.origin);
+        }
+        return true;
+    }
+    if (it == m_pending.end() || it->second.expectedAck != msg.type) {
+        // Confirmação atrasada ou duplicada. Um PUBREC repetido ainda precisa de PUBREL.
+        if (msg.type == MQTTSN_PUBREC) {
+            MqttSnMessage rel;
+            rel.type = MQTTSN_PUBREL;
+            rel.msgId = msg.msgId;
+            SendMessage(rel, from);
+        }
+        return true;
+    }
+    Pending pending = it->second;
+    Simulator::Cancel(pending.timer);
+    m_pending.erase(it);
+    if (msg.type == MQTTSN_PUBREC) {
+        // QoS 2, segunda fase: PUBREL confirmado por PUBCOMP, mantendo a referência de latência.
+        MqttSnMessage rel;
+        rel.type = MQTTSN_PUBREL;
+        rel.msgId = msg.msgId;
+        SendConfirmed(rel, MQTTSN_PUBCOMP, from, pending.firstSent, Time(), pending.origin);
+        return true;
+    }
+    OnConfirmed(pending.origin, msg, Simulator::Now() - pending.firstSent);
+    return true;
+}
+
+bool MqttSnEndpoint::AcceptPublish(const MqttSnMessage& msg, const Address& from) {
+    uint8_t qos = msg.GetQos();
+    if (qos == 1) {
+        MqttSnMessage ack;
+        ack.type = MQTTSN_PUBACK;
+        ack.topicId = msg.topicId;
+        ack.msgId = msg.msgId;
+        ack.returnCode = MQTTSN_RC_ACCEPTED;
+        SendMessage(ack, from);
+    } else if (qos == 2) {
+        MqttSnMessage rec;
+        rec.type = MQTTSN_PUBREC;
+        rec.msgId = msg.msgId;
+        SendMessage(rec, from);
+        // Entrega apenas a primeira cópia; duplicatas só repetem o PUBREC.
+        return m_qos2Received.insert(std::make_pair(from, msg.msgId)).second;
+    }
+    return true;
+}
+
+void MqttSnEndpoint::HandlePubrel(const MqttSnMessage& msg, const Address& from) {
+    m_qos2Received.erase(std::make_pair(from, msg.msgId));
+    MqttSnMessage comp;
+    comp.type = MQTTSN_PUBCOMP;
+    comp.msgId = msg.msgId;
+    SendMessage(comp, from);
+}
+
+void MqttSnEndpoint::HandleRead(Ptr<Socket> socket) {
+    Ptr<Packet> packet;
+    Address from;
+    while ((packet = socket->RecvFrom(from))) {
+        m_packetsReceived++;
+        LogReceivedPacket(m_nodeId, packet->GetSize());
+        ReceivePacket(packet, from);
+    }
+}
+
+void MqttSnEndpoint::ReceivePacket(Ptr<Packet> packet, const Address& from) {
+    DispatchPacket(packet, from);
+}
+
+void MqttSnEndpoint::DispatchPacket(Ptr<Packet> packet, Address from) {
+    uint32_t size = packet->GetSize();
+    if (m_rxBuffer.size() < size) {
+        m_rxBuffer.resize(size);
+    }
+    packet->CopyData(m_rxBuffer.data(), size);
+    MqttSnMessage msg;
+    if (!DecodeMqttSn(m_rxBuffer.data(), size, msg)) {
+        NS_LOG_ERROR("Node " << m_nodeId << " received a malformed MQTT-SN message");
+        return;
+    }
+    HandleMessage(msg, from, packet);
+}
+
+// Sensor MQTT-SN: registra seu tópico no broker (REGISTER/REGACK) e publica leituras de
+// temperatura e umidade com o QoS configurado, segundo o modelo de carga.
+class MqttPublisher : public MqttSnEndpoint {
+public:
+    MqttPublisher();  // Construtor.
+    // Função para configurar o aplicativo com o endereço do broker, porta, ID do nó e limite de pacotes.
+    void Setup(Ipv6Address address, uint16_t port, uint32_t nodeId, uint32_t maxPackets);
+    // Nível de QoS das publicações (0, 1 ou 2).
+    void SetQos(uint8_t qos) { m_qos = std::min<uint8_t>(qos, 2); }
+    // Formato do conteúdo das publicações.
+    void SetPayloadFormat(PayloadFormat format) { m_payloadFormat = format; }
+    // Define o modelo de carga do sensor; trace só é usado pelo modelo TRACE.
+    void SetWorkload(const WorkloadConfig& workload, WorkloadTrace trace = WorkloadTrace());
+    // Atribui números de stream fixos às variáveis aleatórias da aplicação, a partir de stream.
+    // Retorna a quantidade de streams usados.
+    int64_t AssignStreams(int64_t stream);
+    // Métodos para obter o número de publicações enviadas, confirmadas e perdidas.
+    uint32_t GetPacketsSent() const { return m_packetCount; }
+    uint32_t GetPublishesCompleted() const { return m_publishesCompleted; }
+    uint32_t GetPublishesFailed() const { return m_publishesFailed; }
+    // Duty cycling: o rádio fica desligado entre as transmissões e só escuta durante rxWindow
+    // após cada envio, o suficiente para receber REGACK/PUBACK/PUBREC/PUBCOMP do broker.
+    void SetDutyCycle(Ptr<lrwpan::LrWpanMac> mac, Time rxWindow);
+    // Desliga o sensor (bateria esgotada): para as publicações e fecha o socket.
+    void PowerOff();
+private:
+    // Funções virtuais sobrescritas de Application para iniciar e parar a aplicação.
+    virtual void StartApplication(void);
+    virtual void StopApplication(void);
+    void HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) override;
+    void OnConfirmed(uint8_t origin, const MqttSnMessage& ack, Time latency) override;
+    void OnFailed(uint8_t origin, uint16_t msgId) override;
+    // Backpressure do broker: adia a próxima publicação até o fim da espera.
+    void OnCongestion(uint8_t origin) override;
+    // Liga a recepção do rádio (duty cycling) e agenda o desligamento após m_rxWindow.
+    void OnTransmit() override;
+    // Desliga a recepção do rádio quando a MAC ficar ociosa.
+    void Sleep();
+    // Registra o tópico do sensor no broker.
+    void SendRegister();
+    // Publica uma leitura e agenda a próxima.
+    void SendPublish();
+    // Sorteia o intervalo até a próxima publicação de acordo com o modelo de carga.
+    // Retorna false se não há próxima publicação (fim do trace).
+    bool NextInterval(Time& interval);
+    Ipv6Address m_peerAddress;  // Endereço IPv6 do broker (gateway).
+    uint16_t m_port;  // Porta de comunicação (1883 para MQTT).
+    Address m_broker;  // Endereço e porta do broker.
+    std::string m_topicName;  // Tópico do sensor ("sensors/<id>").
+    uint16_t m_topicId;  // TopicId atribuído pelo broker (0 = ainda não registrado).
+    uint8_t m_qos;  // QoS das publicações.
+    PayloadFormat m_payloadFormat;  // Formato do conteúdo das publicações.
+    uint8_t m_payload[SENSOR_PAYLOAD_MAX];  // Buffer do conteúdo, reutilizado a cada publicação.
+    uint32_t m_maxPackets;  // Número máximo de pacotes que o sensor pode enviar.
+    WorkloadConfig m_workload;  // Modelo de carga do sensor.
+    WorkloadTrace m_trace;  // Intervalos reproduzidos pelo modelo TRACE.
+    size_t m_traceIndex;  // Próximo intervalo do trace.
+    Time m_onUntil;  // Fim do período ON atual (modelo ONOFF).
+    Ptr<UniformRandomVariable> m_readingRv;  // Leituras simuladas de temperatura e umidade.
+    Ptr<UniformRandomVariable> m_intervalRv;  // Intervalos do modelo UNIFORM.
+    Ptr<ExponentialRandomVariable> m_expRv;  // Intervalos dos modelos POISSON e ONOFF.
+    EventId m_sendEvent;  // Próxima publicação agendada.
+    uint32_t m_packetCount;  // Contador de publicações enviadas pelo nó.
+    uint32_t m_publishesCompleted;  // Publicações QoS 1/2 confirmadas.
+    uint32_t m_publishesFailed;  // Publicações QoS 1/2 sem confirmação após as retransmissões.
+    Ptr<lrwpan::LrWpanMac> m_mac;  // MAC do sensor, se o duty cycling estiver ativo.
+    Time m_rxWindow;  // Janela de recepção após cada transmissão.
+    EventId m_sleepEvent;  // Desligamento agendado do rádio.
+    bool m_running;  // Flag para indicar se a aplicação está ativa.
+};
+
+// Construtor: inicializa variáveis com valores padrão.
+MqttPublisher::MqttPublisher() 
+    : m_port(0), 
+      m_topicId(0), 
+      m_qos(1), 
+      m_payloadFormat(PayloadFormat::BINARY), 
+      m_maxPackets(10), 
+      m_traceIndex(0), 
+      m_readingRv(CreateObject<UniformRandomVariable>()), 
+      m_intervalRv(CreateObject<UniformRandomVariable>()), 
+      m_expRv(CreateObject<ExponentialRandomVariable>()), 
+      m_packetCount(0), 
+      m_publishesCompleted(0), 
+      m_publishesFailed(0), 
+      m_running(false) {}
+
+// Configura o aplicativo com o endereço do broker, porta, ID do nó e limite de pacotes.
+void MqttPublisher::Setup(Ipv6Address address, uint16_t port, uint32_t nodeId, uint32_t maxPackets) {
+    m_peerAddress = address;  // Endereço do broker no gateway.
+    m_port = port;  // Porta MQTT (1883).
+    m_nodeId = nodeId;  // ID global do nó.
+    m_maxPackets = maxPackets;  // Limite de publicações.
+    m_broker = Inet6SocketAddress(m_peerAddress, m_port);
+    m_topicName = "sensors/" + std::to_string(nodeId);
+}
+
+// Define o modelo de carga do sensor.
+void MqttPublisher::SetWorkload(const WorkloadConfig& workload, WorkloadTrace trace) {
+    m_workload = workload;
+    m_workload.maxInterval = std::max(workload.minInterval, workload.maxInterval);
+    m_trace = trace;
+    m_traceIndex = 0;
+}
+
+// Fixa os streams das variáveis aleatórias, para que cada sensor tenha uma sequência própria e reproduzível.
+int64_t MqttPublisher::AssignStreams(int64_t stream) {
+    m_readingRv->SetStream(stream);
+    m_intervalRv->SetStream(stream + 1);
+    m_expRv->SetStream(stream + 2);
+    return 3;
+}
+
+// Sorteia o intervalo até a próxima publicação.
+bool MqttPublisher::NextInterval(Time& interval) {
+    switch (m_workload.model) {
+        case WorkloadModel::UNIFORM: {
+            // Intervalo entre minInterval e maxInterval em passos de 0,1 s.
+            uint32_t steps = static_cast<uint32_t>(std::lround((m_workload.maxInterval - m_workload.minInterval) * 10.0));
+            uint32_t step = steps > 0 ? m_intervalRv->GetInteger(0, steps - 1) : 0;
+            interval = Seconds(m_workload.minInterval + step / 10.0);
+            return true;
+        }
+        case WorkloadModel::PERIODIC:
+            interval = Seconds(m_workload.period);
+            return true;
+        case WorkloadModel::POISSON:
+            interval = Seconds(m_expRv->GetValue(m_workload.meanInterval, 0));
+            return true;
+        case WorkloadModel::ONOFF: {
+            Time now = Simulator::Now();
+            if (m_onUntil.IsZero()) {
+                // Primeira publicação: inicia um período ON.
+                m_onUntil = now + Seconds(m_expRv->GetValue(m_workload.onMean, 0));
+            }
+            Time next = now + Seconds(m_workload.burstInterval);
+            if (next > m_onUntil) {
+                // Fim da rajada: espera um período OFF e começa um novo ON.
+                next = m_onUntil + Seconds(m_expRv->GetValue(m_workload.offMean, 0));
+                m_onUntil = next + Seconds(m_expRv->GetValue(m_workload.onMean, 0));
+            }
+            interval = next - now;
+            return true;
+        }
+        case WorkloadModel::TRACE:
+            if (!m_trace || m_traceIndex >= m_trace->size()) {
+                return false;
+            }
+            interval = Seconds((*m_trace)[m_traceIndex++]);
+            return true;
+    }
+    return false;
+}
+
+// Ativa o duty cycling do rádio do sensor.
+void MqttPublisher::SetDutyCycle(Ptr<lrwpan::LrWpanMac> mac, Time rxWindow) {
+    m_mac = mac;
+    m_rxWindow = rxWindow;
+}
+
+void MqttPublisher::OnTransmit() {
+    if (!m_mac || !m_running) {
+        return;
+    }
+    m_mac->SetRxOnWhenIdle(true);
+    Simulator::Cancel(m_sleepEvent);
+    m_sleepEvent = Simulator::Schedule(m_rxWindow, &MqttPublisher::Sleep, this);
+}
+
+void MqttPublisher::Sleep() {
+    // Com RxOnWhenIdle desligado a MAC põe o transceptor em TRX_OFF ao terminar a transmissão atual.
+    m_mac->SetRxOnWhenIdle(false);
+}
+
+void MqttPublisher::PowerOff() {
+    if (m_running) {
+        StopApplication();
+    }
+}
+
+// Função chamada para iniciar a aplicação: abre o socket e registra o tópico no broker.
+void MqttPublisher::StartApplication(void) {
+    m_running = true;  // Marca a aplicação como ativa.
+    // Vincula o socket a uma porta local qualquer.
+    if (!m_socket && !OpenSocket(0)) {
+        return;
+    }
+    // As publicações começam quando o broker confirmar o registro do tópico (REGACK).
+    SendRegister();
+}
+
+// Envia o REGISTER do tópico do sensor.
+void MqttPublisher::SendRegister() {
+    MqttSnMessage reg;
+    reg.type = MQTTSN_REGISTER;
+    reg.msgId = NextMsgId();
+    reg.data = reinterpret_cast<const uint8_t*>(m_topicName.data());
+    reg.dataLength = m_topicName.size();
+    SendConfirmed(reg, MQTTSN_REGACK, m_broker, Simulator::Now(), Time(), MQTTSN_REGISTER);
+}
+
+// Função para lidar com mensagens recebidas do broker (confirmações).
+void MqttPublisher::HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) {
+    HandleAck(msg, from);
+}
+
+// Confirmações do broker: REGACK libera as publicações; PUBACK/PUBCOMP concluem uma publicação.
+void MqttPublisher::OnConfirmed(uint8_t origin, const MqttSnMessage& ack, Time latency) {
+    if (origin == MQTTSN_REGISTER) {
+        if (ack.returnCode != MQTTSN_RC_ACCEPTED) {
+            NS_LOG_ERROR("Node " << m_nodeId << " topic registration rejected with code " << uint32_t(ack.returnCode));
+            return;
+        }
+        m_topicId = ack.topicId;
+        if (m_running && !m_sendEvent.IsPending() && m_packetCount < m_maxPackets) {
+            SendPublish();
+        }
+        return;
+    }
+    m_publishesCompleted++;
+    LogMqttEvent(m_nodeId, EventType::PUBLISH_COMPLETED, MQTTSN_PUBLISH, ack.msgId, m_topicId, m_qos, 0, latency);
+}
+
+// Mensagens não confirmadas: o REGISTER é repetido enquanto a aplicação estiver ativa.
+void MqttPublisher::OnFailed(uint8_t origin, uint16_t msgId) {
+    if (origin == MQTTSN_REGISTER) {
+        if (m_running) {
+            SendRegister();
+        }
+        return;
+    }
+    m_publishesFailed++;
+}
+
+void MqttPublisher::OnCongestion(uint8_t origin) {
+    if (m_sendEvent.IsPending() && Simulator::GetDelayLeft(m_sendEvent) < m_congestionWait) {
+        Simulator::Cancel(m_sendEvent);
+        m_sendEvent = Simulator::Schedule(m_congestionWait, &MqttPublisher::SendPublish, this);
+    }
+}
+
+// Publica uma leitura de temperatura e umidade.
+void MqttPublisher::SendPublish() {
+    // Sorteia uma leitura simulada e a codifica direto no buffer da aplicação (sem alocação).
+    int16_t tempDeci = static_cast<int16_t>(200 + m_readingRv->GetInteger(0, 99));  // Temperatura entre 20 e 30°C.
+    uint8_t hum = static_cast<uint8_t>(50 + m_readingRv->GetInteger(0, 29));  // Umidade entre 50 e 80%.
+    uint32_t payloadLength = EncodeSensorPayload(m_payloadFormat, m_packetCount, tempDeci, hum, m_payload);
+
+    // Monta o PUBLISH MQTT-SN com o TopicId registrado.
+    MqttSnMessage pub;
+    pub.type = MQTTSN_PUBLISH;
+    pub.SetQos(m_qos);
+    pub.topicId = m_topicId;
+    pub.msgId = m_qos > 0 ? NextMsgId() : 0;
+    pub.data = m_payload;
+    pub.dataLength = payloadLength;
+
+    // Envia o pacote e registra o evento no log.
+    Time now = Simulator::Now();
+    int result = m_qos == 0 ? SendMessage(pub, m_broker, now)
+                            : SendConfirmed(pub, m_qos == 1 ? MQTTSN_PUBACK : MQTTSN_PUBREC, m_broker, now, now, MQTTSN_PUBLISH);
+    uint32_t bodySize = MqttSnBodySize(pub);
+    LogSentPacket(m_nodeId, m_packetCount, tempDeci, hum, result, MqttSnLengthFieldSize(bodySize) + bodySize);
+    m_packetCount++;  // Incrementa o contador de pacotes enviados.
+
+    // Se ainda não atingiu o limite de pacotes, agenda o próximo envio segundo o modelo de carga.
+    Time interval;
+    if (m_packetCount >= m_maxPackets) {
+        LogReachedMaxPackets(m_nodeId, m_maxPackets);
+    } else if (m_running && NextInterval(interval)) {
+        m_sendEvent = Simulator::Schedule(interval, &MqttPublisher::SendPublish, this);
+    }
+}
+
+// Função chamada para parar a aplicação.
+void MqttPublisher::StopApplication(void) {
+    m_running = false;  // Marca a aplicação como inativa.
+    Simulator::Cancel(m_sendEvent);  // Cancela a próxima publicação agendada.
+    Simulator::Cancel(m_sleepEvent);
+    if (m_mac) {
+        m_mac->SetRxOnWhenIdle(false);  // Sensor parado: rádio desligado.
+    }
+    CloseSocket();  // Fecha o socket e descarta as mensagens pendentes.
+}
+
+// Assinante MQTT-SN: assina um filtro de tópicos no broker e mede a latência fim a fim
+// das publicações repassadas.
+class MqttSubscriber : public MqttSnEndpoint {
+public:
+    MqttSubscriber();
+    // Configura o endereço do broker, porta, ID do nó, filtro de tópicos e QoS máximo da assinatura.
+    void Setup(Ipv6Address address, uint16_t port, uint32_t nodeId, const std::string& topicFilter, uint8_t qos);
+    uint32_t GetMessagesDelivered() const { return m_delivered; }
+private:
+    virtual void StartApplication(void);
+    virtual void StopApplication(void);
+    void HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) override;
+    void OnConfirmed(uint8_t origin, const MqttSnMessage& ack, Time latency) override;
+    void OnFailed(uint8_t origin, uint16_t msgId) override;
+    void SendSubscribe();
+    Address m_broker;  // Endereço e porta do broker.
+    std::string m_topicFilter;  // Filtro assinado (ex.: "sensors/#").
+    uint8_t m_qos;  // QoS máximo da assinatura.
+    bool m_running;
+    uint32_t m_delivered;  // Publicações entregues.
+};
+
+MqttSubscriber::MqttSubscriber()
+    : m_qos(1),
+      m_running(false),
+      m_delivered(0) {}
+
+void MqttSubscriber::Setup(Ipv6Address address, uint16_t port, uint32_t nodeId, const std::string& topicFilter, uint8_t qos) {
+    m_broker = Inet6SocketAddress(address, port);
+    m_nodeId = nodeId;
+    m_topicFilter = topicFilter;
+    m_qos = std::min<uint8_t>(qos, 2);
+}
+
+void MqttSubscriber::StartApplication(void) {
+    m_running = true;
+    if (!m_socket && !OpenSocket(0)) {
+        return;
+    }
+    SendSubscribe();
+}
+
+void MqttSubscriber::StopApplication(void) {
+    m_running = false;
+    CloseSocket();
+}
+
+void MqttSubscriber::SendSubscribe() {
+    MqttSnMessage sub;
+    sub.type = MQTTSN_SUBSCRIBE;
+    sub.SetQos(m_qos);
+    sub.msgId = NextMsgId();
+    sub.data = reinterpret_cast<const uint8_t*>(m_topicFilter.data());
+    sub.dataLength = m_topicFilter.size();
+    SendConfirmed(sub, MQTTSN_SUBACK, m_broker, Simulator::Now(), Time(), MQTTSN_SUBSCRIBE);
+}
+
+void MqttSubscriber::HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) {
+    if (HandleAck(msg, from)) {
+        return;
+    }
+    switch (msg.type) {
+        case MQTTSN_REGISTER: {
+            // O broker informa o TopicId de um tópico que casa com a assinatura antes de repassá-lo.
+            MqttSnMessage ack;
+            ack.type = MQTTSN_REGACK;
+            ack.topicId = msg.topicId;
+            ack.msgId = msg.msgId;
+            ack.returnCode = MQTTSN_RC_ACCEPTED;
+            SendMessage(ack, from);
+            break;
+        }
+        case MQTTSN_PUBLISH:
+            if (AcceptPublish(msg, from)) {
+                m_delivered++;
+                PublishTimeTag tag;
+                Time latency = packet->PeekPacketTag(tag) ? Simulator::Now() - tag.GetTime() : Time();
+                LogMqttEvent(m_nodeId, EventType::MESSAGE_DELIVERED, MQTTSN_PUBLISH, msg.msgId, msg.topicId,
+                             msg.GetQos(), 0, latency);
+            }
+            break;
+        case MQTTSN_PUBREL:
+            HandlePubrel(msg, from);
+            break;
+    }
+}
+
+void MqttSubscriber::OnConfirmed(uint8_t origin, const MqttSnMessage& ack, Time latency) {
+    if (origin == MQTTSN_SUBSCRIBE && ack.returnCode != MQTTSN_RC_ACCEPTED) {
+        NS_LOG_ERROR("Node " << m_nodeId << " subscription to " << m_topicFilter << " rejected");
+    }
+}
+
+void MqttSubscriber::OnFailed(uint8_t origin, uint16_t msgId) {
+    if (origin == MQTTSN_SUBSCRIBE && m_running) {
+        SendSubscribe();
+    }
+}
+
+// O que o broker faz com uma mensagem que chega com a fila de entrada cheia.
+enum class OverflowPolicy {
+    DROP,          // Descarta em silêncio; o cliente retransmite após o timeout.
+    BACKPRESSURE,  // Responde com MQTTSN_RC_CONGESTION; o cliente espera e reenvia.
+};
+
+bool ParseOverflowPolicy(const std::string& name, OverflowPolicy& policy) {
+    if (name == "drop") { policy = OverflowPolicy::DROP; return true; }
+    if (name == "backpressure") { policy = OverflowPolicy::BACKPRESSURE; return true; }
+    return false;
+}
+
+// Broker MQTT-SN no gateway: atribui TopicIds (REGISTER), guarda as assinaturas (SUBSCRIBE),
+// confirma as publicações segundo o QoS e as repassa aos assinantes. Cada mensagem recebida
+// é processada após um tempo de serviço, que representa o custo de processamento do broker.
+// Com SetCapacity, o broker é uma fila M/G/c/K: c workers atendem uma mensagem cada, e as que
+// chegam com todos ocupados esperam numa fila de entrada limitada.
+class MqttBroker : public MqttSnEndpoint {
+public:
+    MqttBroker();
+    // Configura a porta de escuta, o ID do nó e o tempo de serviço (médio) por mensagem.
+    void Setup(uint16_t port, uint32_t nodeId, Time processingDelay);
+    // Número de workers, limite da fila de entrada (0 = sem limite) e política de estouro.
+    // Com workers = 0 (padrão) cada mensagem só sofre o atraso, sem disputa entre elas.
+    void SetCapacity(uint32_t workers, uint32_t queueLimit, OverflowPolicy policy);
+    // Tempo de serviço exponencial (com a média de Setup) em vez de constante.
+    void SetExponentialService(bool exponential) { m_exponentialService = exponential; }
+    int64_t AssignStreams(int64_t stream);
+    uint64_t GetPublishesReceived() const { return m_publishesReceived; }
+    uint64_t GetPublishesForwarded() const { return m_publishesForwarded; }
+    // Latência das publicações aceitas em um tópico (publicador -> broker), ou nullptr se o tópico não existe.
+    const LatencyHistogram* GetTopicLatency(const std::string& topic) const;
+    // Estatísticas da fila de entrada.
+    uint32_t GetWorkers() const { return m_workers; }
+    uint64_t GetArrivals() const { return m_arrivals; }
+    uint64_t GetServed() const { return m_served; }
+    uint64_t GetDropped() const { return m_dropped; }
+    uint64_t GetRejected() const { return m_rejected; }
+    uint32_t GetMaxQueue() const { return m_maxQueue; }
+    // Espera na fila antes do atendimento.
+    const LatencyHistogram& GetQueueWait() const { return m_queueWait; }
+    // Fração do tempo em que os workers estiveram ocupados desde o início do broker.
+    double GetUtilization() const;
+private:
+    // Assinatura de um cliente.
+    struct Subscription {
+        Address client;
+        std::string filter;
+        uint8_t qos;
+        std::set<uint16_t> registered;  // TopicIds já informados ao assinante via REGISTER.
+    };
+    virtual void StartApplication(void);
+    virtual void StopApplication(void);
+    void ReceivePacket(Ptr<Packet> packet, const Address& from) override;
+    void HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) override;
+    // Retorna o TopicId de um nome de tópico, atribuindo um novo se necessário.
+    uint16_t RegisterTopic(const std::string& name);
+    // Repassa uma publicação a todos os assinantes cujo filtro casa com o tópico.
+    void Forward(const MqttSnMessage& msg, Time publishTime);
+    // Índices das assinaturas que casam com um TopicId (em cache até a próxima assinatura).
+    const std::vector<uint32_t>& MatchingSubscriptions(uint16_t topicId);
+    // Envia uma resposta a um cliente e registra o evento no log.
+    void Reply(const MqttSnMessage& msg, const Address& to);
+    // Mensagem aguardando um worker.
+    struct QueuedMessage {
+        Ptr<Packet> packet;
+        Address from;
+        Time arrival;
+    };
+    // Ocupa um worker com a mensagem; FinishService a processa ao fim do tempo de serviço.
+    void StartService(Ptr<Packet> packet, const Address& from, Time arrival);
+    void FinishService(Ptr<Packet> packet, Address from);
+    // Fila cheia: descarta ou rejeita por congestionamento, segundo m_overflow.
+    void Overflow(Ptr<Packet> packet, const Address& from);
+    Time ServiceTime();
+
+    uint16_t m_port;
+    Time m_processingDelay;  // Tempo de serviço (médio) por mensagem.
+    uint32_t m_workers;  // Workers do broker (0 = sem disputa).
+    uint32_t m_queueLimit;  // Mensagens na fila de entrada (0 = sem limite).
+    OverflowPolicy m_overflow;
+    bool m_exponentialService;
+    Ptr<ExponentialRandomVariable> m_serviceRv;
+    std::deque<QueuedMessage> m_queue;
+    uint32_t m_busy;  // Workers ocupados.
+    Time m_busyTime;  // Soma dos tempos de serviço iniciados.
+    Time m_startTime;
+    uint64_t m_arrivals;
+    uint64_t m_served;
+    uint64_t m_dropped;
+    uint64_t m_rejected;
+    uint32_t m_maxQueue;
+    LatencyHistogram m_queueWait;
+    std::vector<uint8_t> m_rejectBuffer;  // Buffer reutilizado para ler as mensagens rejeitadas.
+    std::map<std::string, uint16_t> m_topicIds;  // Nome do tópico -> TopicId.
+    std::vector<std::string> m_topicNames;  // TopicId - 1 -> nome do tópico.
+    std::vector<LatencyHistogram> m_topicLatency;  // TopicId - 1 -> latência das publicações recebidas.
+    std::vector<Subscription> m_subscriptions;
+    std::map<uint16_t, std::vector<uint32_t>> m_matchCache;
+    uint64_t m_publishesReceived;
+    uint64_t m_publishesForwarded;
+};
+
+MqttBroker::MqttBroker()
+    : m_port(0),
+      m_workers(0),
+      m_queueLimit(0),
+      m_overflow(OverflowPolicy::DROP),
+      m_exponentialService(false),
+      m_serviceRv(CreateObject<ExponentialRandomVariable>()),
+      m_busy(0),
+      m_arrivals(0),
+      m_served(0),
+      m_dropped(0),
+      m_rejected(0),
+      m_maxQueue(0),
+      m_publishesReceived(0),
+      m_publishesForwarded(0) {}
+
+void MqttBroker::Setup(uint16_t port, uint32_t nodeId, Time processingDelay) {
+    m_port = port;
+    m_nodeId = nodeId;
+    m_processingDelay = processingDelay;
+}
+
+void MqttBroker::SetCapacity(uint32_t workers, uint32_t queueLimit, OverflowPolicy policy) {
+    m_workers = workers;
+    m_queueLimit = queueLimit;
+    m_overflow = policy;
+}
+
+int64_t MqttBroker::AssignStreams(int64_t stream) {
+    m_serviceRv->SetStream(stream);
+    return 1;
+}
+
+double MqttBroker::GetUtilization() const {
+    double elapsed = (Simulator::Now() - m_startTime).GetSeconds() * m_workers;
+    return elapsed > 0 ? std::min(1.0, m_busyTime.GetSeconds() / elapsed) : 0.0;
+}
+
+void MqttBroker::StartApplication(void) {
+    m_startTime = Simulator::Now();
+    // Vincula o socket à porta 1883 para escutar pacotes (endereço "any").
+    if (!m_socket) {
+        OpenSocket(m_port);
+    }
+}
+
+void MqttBroker::StopApplication(void) {
+    CloseSocket();
+}
+
+void MqttBroker::ReceivePacket(Ptr<Packet> packet, const Address& from) {
+    m_arrivals++;
+    if (m_workers == 0) {
+        m_served++;
+        if (m_processingDelay.IsZero()) {
+            DispatchPacket(packet, from);
+        } else {
+            Simulator::Schedule(ServiceTime(), &MqttBroker::DispatchPacket, this, packet, from);
+        }
+        return;
+    }
+    if (m_busy < m_workers) {
+        StartService(packet, from, Simulator::Now());
+    } else if (m_queueLimit == 0 || m_queue.size() < m_queueLimit) {
+        m_queue.push_back(QueuedMessage{packet, from, Simulator::Now()});
+        m_maxQueue = std::max<uint32_t>(m_maxQueue, m_queue.size());
+    } else {
+        Overflow(packet, from);
+    }
+}
+
+Time MqttBroker::ServiceTime() {
+    return m_exponentialService ? Seconds(m_serviceRv->GetValue(m_processingDelay.GetSeconds(), 0)) : m_processingDelay;
+}
+
+void MqttBroker::StartService(Ptr<Packet> packet, const Address& from, Time arrival) {
+    m_busy++;
+    m_queueWait.Record((Simulator::Now() - arrival).GetNanoSeconds());
+    Time service = ServiceTime();
+    m_busyTime += service;
+    Simulator::Schedule(service, &MqttBroker::FinishService, this, packet, from);
+}
+
+void MqttBroker::FinishService(Ptr<Packet> packet, Address from) {
+    m_busy--;
+    m_served++;
+    DispatchPacket(packet, from);
+    if (!m_queue.empty()) {
+        QueuedMessage next = m_queue.front();
+        m_queue.pop_front();
+        StartService(next.packet, next.from, next.arrival);
+    }
+}
+
+void MqttBroker::Overflow(Ptr<Packet> packet, const Address& from) {
+    // A mensagem é lida fora dos workers (como a thread de rede de um broker real) só para rejeitá-la.
+    MqttSnMessage msg;
+    uint8_t ackType = 0;
+    uint32_t size = packet->GetSize();
+    if (m_overflow == OverflowPolicy::BACKPRESSURE && m_rejectBuffer.size() < size) {
+        m_rejectBuffer.resize(size);
+    }
+    if (m_overflow == OverflowPolicy::BACKPRESSURE && packet->CopyData(m_rejectBuffer.data(), size) == size &&
+        DecodeMqttSn(m_rejectBuffer.data(), size, msg)) {
+        if (msg.type == MQTTSN_REGISTER) ackType = MQTTSN_REGACK;
+        else if (msg.type == MQTTSN_SUBSCRIBE) ackType = MQTTSN_SUBACK;
+        else if (msg.type == MQTTSN_PUBLISH && msg.GetQos() > 0) ackType = MQTTSN_PUBACK;
+    }
+    if (ackType == 0) {
+        m_dropped++;
+        return;
+    }
+    MqttSnMessage reject;
+    reject.type = ackType;
+    reject.topicId = msg.topicId;
+    reject.msgId = msg.msgId;
+    reject.returnCode = MQTTSN_RC_CONGESTION;
+    SendMessage(reject, from);
+    m_rejected++;
+}
+
+uint16_t MqttBroker::RegisterTopic(const std::string& name) {
+    auto it = m_topicIds.find(name);
+    if (it != m_topicIds.end()) {
+        return it->second;
+    }
+    m_topicNames.push_back(name);
+    m_topicLatency.emplace_back();
+    uint16_t topicId = static_cast<uint16_t>(m_topicNames.size());
+    m_topicIds.emplace(name, topicId);
+    return topicId;
+}
+
+const LatencyHistogram* MqttBroker::GetTopicLatency(const std::string& topic) const {
+    auto it = m_topicIds.find(topic);
+    return it == m_topicIds.end() ? nullptr : &m_topicLatency[it->second - 1];
+}
+
+void MqttBroker::Reply(const MqttSnMessage& msg, const Address& to) {
+    SendMessage(msg, to);
+    LogGatewayResponse(m_nodeId, Inet6SocketAddress::ConvertFrom(to).GetIpv6());
+}
+
+void MqttBroker::HandleMessage(const MqttSnMessage& msg, const Address& from, Ptr<Packet> packet) {
+    // Confirmações dos assinantes para as publicações repassadas.
+    if (HandleAck(msg, from)) {
+        return;
+    }
+    switch (msg.type) {
+        case MQTTSN_REGISTER: {
+            MqttSnMessage ack;
+            ack.type = MQTTSN_REGACK;
+            ack.topicId = RegisterTopic(std::string(reinterpret_cast<const char*>(msg.data), msg.dataLength));
+            ack.msgId = msg.msgId;
+            ack.returnCode = MQTTSN_RC_ACCEPTED;
+            Reply(ack, from);
+            break;
+        }
+        case MQTTSN_SUBSCRIBE: {
+            std::string filter(reinterpret_cast<const char*>(msg.data), msg.dataLength);
+            bool wildcard = filter.find_first_of("+#") != std::string::npos;
+            Subscription* subscription = nullptr;
+            for (Subscription& s : m_subscriptions) {
+                if (s.client == from && s.filter == filter) {
+                    subscription = &s;  // SUBSCRIBE repetido (retransmissão): atualiza o QoS.
+                }
+            }
+            if (!subscription) {
+                m_subscriptions.push_back(Subscription{from, filter, 0, {}});
+                subscription = &m_subscriptions.back();
+                m_matchCache.clear();
+            }
+            subscription->qos = msg.GetQos();
+            MqttSnMessage ack;
+            ack.type = MQTTSN_SUBACK;
+            ack.SetQos(subscription->qos);
+            ack.topicId = wildcard ? 0 : RegisterTopic(filter);
+            ack.msgId = msg.msgId;
+            ack.returnCode = MQTTSN_RC_ACCEPTED;
+            Reply(ack, from);
+            break;
+        }
+        case MQTTSN_PUBLISH: {
+            if (msg.topicId == 0 || msg.topicId > m_topicNames.size()) {
+                if (msg.GetQos() > 0) {
+                    MqttSnMessage ack;
+                    ack.type = MQTTSN_PUBACK;
+                    ack.topicId = msg.topicId;
+                    ack.msgId = msg.msgId;
+                    ack.returnCode = MQTTSN_RC_INVALID_TOPIC;
+                    Reply(ack, from);
+                }
+                break;
+            }
+            m_publishesReceived++;
+            bool deliver = AcceptPublish(msg, from);
+            if (msg.GetQos() > 0) {
+                LogGatewayResponse(m_nodeId, Inet6SocketAddress::ConvertFrom(from).GetIpv6());
+            }
+            if (deliver) {
+                PublishTimeTag tag;
+                Time publishTime = packet->PeekPacketTag(tag) ? tag.GetTime() : Simulator::Now();
+                m_topicLatency[msg.topicId - 1].Record((Simulator::Now() - publishTime).GetNanoSeconds());
+                Forward(msg, publishTime);
+            }
+            break;
+        }
+        case MQTTSN_PUBREL:
+            HandlePubrel(msg, from);
+            LogGatewayResponse(m_nodeId, Inet6SocketAddress::ConvertFrom(from).GetIpv6());
+            break;
+    }
+}
+
+const std::vector<uint32_t>& MqttBroker::MatchingSubscriptions(uint16_t topicId) {
+    auto it = m_matchCache.find(topicId);
+    if (it == m_matchCache.end()) {
+        std::vector<uint32_t> matches;
+        const std::string& name = m_topicNames[topicId - 1];
+        for (uint32_t i = 0; i < m_subscriptions.size(); ++i) {
+            if (MqttTopicMatches(m_subscriptions[i].filter, name)) {
+                matches.push_back(i);
+            }
+        }
+        it = m_matchCache.emplace(topicId, std::move(matches)).first;
+    }
+    return it->second;
+}
+
+void MqttBroker::Forward(const MqttSnMessage& msg, Time publishTime) {
+    for (uint32_t index : MatchingSubscriptions(msg.topicId)) {
+        Subscription& subscription = m_subscriptions[index];
+        if (subscription.registered.insert(msg.topicId).second) {
+            // Primeira publicação deste tópico para o assinante: informa o TopicId.
+            const std::string& name = m_topicNames[msg.topicId - 1];
+            MqttSnMessage reg;
+            reg.type = MQTTSN_REGISTER;
+            reg.topicId = msg.topicId;
+            reg.msgId = NextMsgId();
+            reg.data = reinterpret_cast<const uint8_t*>(name.data());
+            reg.dataLength = name.size();
+            SendMessage(reg, subscription.client);
+        }
+        MqttSnMessage pub = msg;
+        pub.flags = 0;
+        uint8_t qos = std::min(msg.GetQos(), subscription.qos);
+        pub.SetQos(qos);
+        pub.msgId = qos > 0 ? NextMsgId() : 0;
+        if (qos == 0) {
+            SendMessage(pub, subscription.client, publishTime);
+        } else {
+            SendConfirmed(pub, qos == 1 ? MQTTSN_PUBACK : MQTTSN_PUBREC, subscription.client, Simulator::Now(),
+                          publishTime, MQTTSN_PUBLISH);
+        }
+        m_publishesForwarded++;
+    }
+}
+
+// Roteamento multi-salto inspirado no RPL (RFC 6550) em modo storing, para a topologia em malha.
+// O gateway é a raiz do DODAG. Cada nó anuncia seu rank em DIOs multicast link-local, controlados
+// por um temporizador Trickle (RFC 6206), escolhe como pai o vizinho de menor rank (função objetivo
+// por número de saltos, como a OF0) e instala a rota padrão através dele. Os DAOs sobem pelo DODAG
+// até a raiz e cada nó no caminho instala uma rota de host para o alvo, formando as rotas descendentes
+// usadas pelo broker para responder aos sensores. As mensagens de controle vão sobre UDP.
+class RplRouter : public Application {
+public:
+    static const uint16_t INFINITE_RANK = 0xFFFF;
+    static const uint16_t MIN_HOP_RANK_INCREASE = 256;  // Incremento de rank por salto.
+
+    RplRouter();
+    // Configura o nó: ID global, se é a raiz, dispositivo 6LoWPAN, endereço global e porta de controle.
+    void Setup(uint32_t nodeId, bool isRoot, Ptr<NetDevice> device, Ipv6Address address, uint16_t port);
+    // Parâmetros do Trickle: intervalo mínimo, número de dobras e constante de redundância k.
+    void SetTrickle(Time imin, uint32_t doublings, uint32_t redundancy);
+    // Intervalo de renovação dos DAOs.
+    void SetDaoInterval(Time interval) { m_daoInterval = interval; }
+    int64_t AssignStreams(int64_t stream);
+    // Número de saltos até a raiz (0 na raiz, UINT32_MAX se o nó ainda não entrou no DODAG).
+    uint32_t GetHopCount() const { return m_rank == INFINITE_RANK ? UINT32_MAX : m_rank / MIN_HOP_RANK_INCREASE - 1; }
+    uint16_t GetRank() const { return m_rank; }
+    Ipv6Address GetParent() const { return m_parent; }
+    uint32_t GetParentChanges() const { return m_parentChanges; }
+    uint64_t GetForwarded() const { return m_forwarded; }
+    uint32_t GetDioSent() const { return m_dioSent; }
+    uint32_t GetDaoSent() const { return m_daoSent; }
+    Ipv6Address GetDodagId() const { return m_dodagId; }
+    // Rotas descendentes aprendidas pelos DAOs: alvo -> próximo salto.
+    const std::map<Ipv6Address, Ipv6Address>& GetDownwardRoutes() const { return m_downward; }
+    // Restaura um estado convergido (snapshot) antes do início: o nó já começa no DODAG, com as rotas
+    // instaladas e o Trickle no intervalo máximo, sem DIS nem a fase de formação.
+    void Restore(uint16_t rank, Ipv6Address parent, Ipv6Address dodagId, const std::map<Ipv6Address, Ipv6Address>& downward);
+private:
+    enum MessageType : uint8_t {
+        RPL_DIO = 1,  // Tipo, versão, rank (2 bytes) e DODAG ID (16 bytes).
+        RPL_DAO = 2,  // Tipo e alvo (16 bytes).
+        RPL_DIS = 3,  // Tipo (pede DIOs aos vizinhos).
+    };
+    // Rank anunciado por um vizinho.
+    struct Neighbor {
+        uint16_t rank;
+        Time lastHeard;
+    };
+    virtual void StartApplication(void);
+    virtual void StopApplication(void);
+    void HandleRead(Ptr<Socket> socket);
+    void HandleDio(const Ipv6Address& from, uint16_t rank, const Ipv6Address& dodagId);
+    void HandleDao(const Ipv6Address& from, const Ipv6Address& target);
+    // Escolhe o pai preferido entre os vizinhos e atualiza rank e rota padrão.
+    void SelectParent();
+    // Reinicia o Trickle no intervalo mínimo (inconsistência detectada).
+    void ResetTrickle();
+    // Começa um novo intervalo do Trickle, com o DIO sorteado em [I/2, I).
+    void StartTrickleInterval();
+    void TrickleFire();
+    void TrickleIntervalEnd();
+    void SendDio();
+    void SendDis();
+    // Envia um DAO com o alvo ao pai preferido.
+    void SendDao(const Ipv6Address& target);
+    // Renova o DAO do próprio endereço e agenda a próxima renovação.
+    void RefreshDao();
+    // Substitui a rota para dest/prefix por uma via nextHop.
+    void ReplaceRoute(Ipv6Address dest, Ipv6Prefix prefix, Ipv6Address nextHop);
+    void Forwarded(const Ipv6Header& header, Ptr<const Packet> packet, uint32_t interface) { m_forwarded++; }
+
+    uint32_t m_nodeId;
+    bool m_isRoot;
+    Ptr<NetDevice> m_device;
+    Ipv6Address m_address;  // Endereço global do nó (alvo dos DAOs).
+    uint16_t m_port;
+    Ptr<Socket> m_socket;
+    Ptr<Ipv6StaticRouting> m_routing;
+    uint32_t m_interface;  // Índice da interface 6LoWPAN no IPv6.
+    uint16_t m_rank;
+    Ipv6Address m_parent;  // Endereço link-local do pai preferido.
+    Ipv6Address m_dodagId;  // Endereço global da raiz.
+    std::map<Ipv6Address, Neighbor> m_neighbors;
+    std::map<Ipv6Address, Ipv6Address> m_downward;
+    bool m_restored;  // Estado carregado de um snapshot (Restore).
+    // Trickle.
+    Time m_imin;
+    uint32_t m_doublings;
+    uint32_t m_redundancy;
+    Time m_interval;  // Intervalo atual (I).
+    uint32_t m_counter;  // DIOs consistentes ouvidos no intervalo (c).
+    EventId m_trickleFire;
+    EventId m_trickleEnd;
+    Time m_daoInterval;
+    EventId m_daoEvent;
+    Ptr<UniformRandomVariable> m_rng;
+    uint32_t m_parentChanges;
+    uint64_t m_forwarded;  // Pacotes encaminhados por este nó (trace UnicastForward).
+    uint32_t m_dioSent;
+    uint32_t m_daoSent;
+};
+
+RplRouter::RplRouter()
+    : m_nodeId(0),
+      m_isRoot(false),
+      m_port(0),
+      m_interface(0),
+      m_rank(INFINITE_RANK),
+      m_restored(false),
+      m_imin(Seconds(0.5)),
+      m_doublings(6),
+      m_redundancy(3),
+      m_counter(0),
+      m_daoInterval(Seconds(10.0)),
+      m_rng(CreateObject<UniformRandomVariable>()),
+      m_parentChanges(0),
+      m_forwarded(0),
+      m_dioSent(0),
+      m_daoSent(0) {}
+
+void RplRouter::Setup(uint32_t nodeId, bool isRoot, Ptr<NetDevice> device, Ipv6Address address, uint16_t port) {
+    m_nodeId = nodeId;
+    m_isRoot = isRoot;
+    m_device = device;
+    m_address = address;
+    m_port = port;
+}
+
+void RplRouter::SetTrickle(Time imin, uint32_t doublings, uint32_t redundancy) {
+    m_imin = imin;
+    m_doublings = doublings;
+    m_redundancy = redundancy;
+}
+
+int64_t RplRouter::AssignStreams(int64_t stream) {
+    m_rng->SetStream(stream);
+    return 1;
+}
+
+void RplRouter::Restore(uint16_t rank, Ipv6Address parent, Ipv6Address dodagId, const std::map<Ipv6Address, Ipv6Address>& downward) {
+    m_rank = rank;
+    m_parent = parent;
+    m_dodagId = dodagId;
+    m_downward = downward;
+    m_restored = true;
+}
+
+void RplRouter::StartApplication(void) {
+    Ptr<Ipv6> ipv6 = GetNode()->GetObject<Ipv6>();
+    m_interface = ipv6->GetInterfaceForDevice(m_device);
+    Ipv6StaticRoutingHelper routingHelper;
+    m_routing = routingHelper.GetStaticRouting(ipv6);
+    // Na malha o prefixo /64 da PAN não é on-link: o tráfego global segue as rotas do DODAG.
+    Ipv6Prefix prefix(64);
+    for (uint32_t i = m_routing->GetNRoutes(); i-- > 0;) {
+        Ipv6RoutingTableEntry route = m_routing->GetRoute(i);
+        if (route.IsNetwork() && route.GetDest() == m_address.CombinePrefix(prefix) &&
+            route.GetDestNetworkPrefix() == prefix && route.GetGateway().IsAny()) {
+            m_routing->RemoveRoute(i);
+        }
+    }
+    GetNode()->GetObject<Ipv6L3Protocol>()->TraceConnectWithoutContext("UnicastForward", MakeCallback(&RplRouter::Forwarded, this));
+
+    m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+    m_socket->Bind(Inet6SocketAddress(Ipv6Address::GetAny(), m_port));
+    m_socket->BindToNetDevice(m_device);  // Mensagens link-local saem pela interface 6LoWPAN.
+    m_socket->SetRecvCallback(MakeCallback(&RplRouter::HandleRead, this));
+
+    if (m_restored) {
+        if (m_isRoot) {
+            m_rank = MIN_HOP_RANK_INCREASE;
+            m_dodagId = m_address;
+        } else if (m_rank != INFINITE_RANK) {
+            // O pai entra na tabela de vizinhos como se o último DIO tivesse acabado de chegar.
+            m_neighbors[m_parent] = Neighbor{static_cast<uint16_t>(m_rank - MIN_HOP_RANK_INCREASE), Simulator::Now()};
+            ReplaceRoute(Ipv6Address::GetAny(), Ipv6Prefix::GetZero(), m_parent);
+            m_daoEvent = Simulator::Schedule(Seconds(m_daoInterval.GetSeconds() * m_rng->GetValue()), &RplRouter::RefreshDao, this);
+        }
+        for (const auto& route : m_downward) {
+            ReplaceRoute(route.first, Ipv6Prefix(128), route.second);
+        }
+        if (m_rank != INFINITE_RANK) {
+            m_interval = Seconds(m_imin.GetSeconds() * (1u << m_doublings));
+            StartTrickleInterval();
+        } else {
+            SendDis();
+        }
+    } else if (m_isRoot) {
+        m_rank = MIN_HOP_RANK_INCREASE;
+        m_dodagId = m_address;
+        ResetTrickle();
+    } else {
+        SendDis();
+    }
+}
+
+void RplRouter::StopApplication(void) {
+    Simulator::Cancel(m_trickleFire);
+    Simulator::Cancel(m_trickleEnd);
+    Simulator::Cancel(m_daoEvent);
+    if (m_socket) {
+        m_socket->Close();
+        m_socket = 0;
+    }
+}
+
+void RplRouter::HandleRead(Ptr<Socket> socket) {
+    Ptr<Packet> packet;
+    Address from;
+    uint8_t buffer[19];
+    while ((packet = socket->RecvFrom(from))) {
+        uint32_t size = std::min<uint32_t>(packet->GetSize(), sizeof(buffer));
+        packet->CopyData(buffer, size);
+        Ipv6Address source = Inet6SocketAddress::ConvertFrom(from).GetIpv6();
+        if (size >= 19 && buffer[0] == RPL_DIO) {
+            HandleDio(source, static_cast<uint16_t>((buffer[1] << 8) | buffer[2]), Ipv6Address(buffer + 3));
+        } else if (size >= 17 && buffer[0] == RPL_DAO) {
+            HandleDao(source, Ipv6Address(buffer + 1));
+        } else if (size >= 1 && buffer[0] == RPL_DIS && m_rank != INFINITE_RANK) {
+            ResetTrickle();
+        }
+    }
+}
+
+void RplRouter::HandleDio(const Ipv6Address& from, uint16_t rank, const Ipv6Address& dodagId) {
+    if (m_isRoot) {
+        m_counter++;
+        return;
+    }
+    m_neighbors[from] = Neighbor{rank, Simulator::Now()};
+    m_dodagId = dodagId;
+    uint16_t oldRank = m_rank;
+    Ipv6Address oldParent = m_parent;
+    SelectParent();
+    if (m_rank == oldRank && m_parent == oldParent) {
+        m_counter++;  // DIO consistente.
+    }
+}
+
+void RplRouter::SelectParent() {
+    // Vizinhos sem DIO há mais de 3 intervalos máximos do Trickle são descartados.
+    Time expiry = Seconds(m_imin.GetSeconds() * (3u << m_doublings));
+    Ipv6Address best;
+    uint16_t bestRank = INFINITE_RANK;
+    for (auto it = m_neighbors.begin(); it != m_neighbors.end();) {
+        if (Simulator::Now() - it->second.lastHeard > expiry) {
+            it = m_neighbors.erase(it);
+            continue;
+        }
+        // Mantém o pai atual em caso de empate, para evitar trocas desnecessárias.
+        if (it->second.rank < bestRank || (it->second.rank == bestRank && it->first == m_parent)) {
+            best = it->first;
+            bestRank = it->second.rank;
+        }
+        ++it;
+    }
+    uint16_t newRank = bestRank >= INFINITE_RANK - MIN_HOP_RANK_INCREASE ? INFINITE_RANK : bestRank + MIN_HOP_RANK_INCREASE;
+    if (newRank == m_rank && best == m_parent) {
+        return;
+    }
+    bool parentChanged = best != m_parent;
+    m_rank = newRank;
+    m_parent = best;
+    if (m_rank == INFINITE_RANK) {
+        return;  // Sem pai: o nó sai do DODAG até ouvir um novo DIO.
+    }
+    if (parentChanged) {
+        m_parentChanges++;
+        ReplaceRoute(Ipv6Address::GetAny(), Ipv6Prefix::GetZero(), m_parent);
+        NS_LOG_INFO("Node " << m_nodeId << " joined DODAG " << m_dodagId << " via " << m_parent << " with rank " << m_rank);
+        RefreshDao();
+    }
+    ResetTrickle();
+}
+
+void RplRouter::HandleDao(const Ipv6Address& from, const Ipv6Address& target) {
+    if (target == m_address) {
+        return;
+    }
+    // Rota descendente: o alvo é alcançado pelo filho que enviou o DAO.
+    ReplaceRoute(target, Ipv6Prefix(128), from);
+    m_downward[target] = from;
+    if (!m_isRoot && m_rank != INFINITE_RANK) {
+        SendDao(target);
+    }
+}
+
+void RplRouter::ReplaceRoute(Ipv6Address dest, Ipv6Prefix prefix, Ipv6Address nextHop) {
+    for (uint32_t i = m_routing->GetNRoutes(); i-- > 0;) {
+        Ipv6RoutingTableEntry route = m_routing->GetRoute(i);
+        if (route.GetDest() == dest && route.GetDestNetworkPrefix() == prefix) {
+            m_routing->RemoveRoute(i);
+        }
+    }
+    if (prefix == Ipv6Prefix::GetZero()) {
+        m_routing->SetDefaultRoute(nextHop, m_interface);
+    } else {
+        m_routing->AddHostRouteTo(dest, nextHop, m_interface);
+    }
+}
+
+void RplRouter::ResetTrickle() {
+    m_interval = m_imin;
+    StartTrickleInterval();
+}
+
+void RplRouter::StartTrickleInterval() {
+    Simulator::Cancel(m_trickleFire);
+    Simulator::Cancel(m_trickleEnd);
+    m_counter = 0;
+    double half = m_interval.GetSeconds() / 2.0;
+    m_trickleFire = Simulator::Schedule(Seconds(m_rng->GetValue(half, 2.0 * half)), &RplRouter::TrickleFire, this);
+    m_trickleEnd = Simulator::Schedule(m_interval, &RplRouter::TrickleIntervalEnd, this);
+}
+
+void RplRouter::TrickleIntervalEnd() {
+    // Dobra o intervalo até Imin * 2^doublings.
+    m_interval = Seconds(std::min(m_interval.GetSeconds() * 2.0, m_imin.GetSeconds() * (1u << m_doublings)));
+    StartTrickleInterval();
+}
+
+void RplRouter::TrickleFire() {
+    // Supressão do Trickle: só transmite se ouviu menos de k DIOs consistentes no intervalo.
+    if (m_counter < m_redundancy && m_rank != INFINITE_RANK) {
+        SendDio();
+    }
+}
+
+void RplRouter::SendDio() {
+    uint8_t buffer[19];
+    buffer[0] = RPL_DIO;
+    buffer[1] = static_cast<uint8_t>(m_rank >> 8);
+    buffer[2] = static_cast<uint8_t>(m_rank);
+    m_dodagId.Serialize(buffer + 3);
+    m_socket->SendTo(Create<Packet>(buffer, sizeof(buffer)), 0, Inet6SocketAddress(Ipv6Address::GetAllNodesMulticast(), m_port));
+    m_dioSent++;
+}
+
+void RplRouter::SendDis() {
+    uint8_t type = RPL_DIS;
+    m_socket->SendTo(Create<Packet>(&type, 1), 0, Inet6SocketAddress(Ipv6Address::GetAllNodesMulticast(), m_port));
+}
+
+void RplRouter::SendDao(const Ipv6Address& target) {
+    uint8_t buffer[17];
+    buffer[0] = RPL_DAO;
+    target.Serialize(buffer + 1);
+    m_socket->SendTo(Create<Packet>(buffer, sizeof(buffer)), 0, Inet6SocketAddress(m_parent, m_port));
+    m_daoSent++;
+}
+
+void RplRouter::RefreshDao() {
+    Simulator::Cancel(m_daoEvent);
+    if (m_rank == INFINITE_RANK) {
+        return;
+    }
+    SendDao(m_address);
+    // Renovação com jitter de até 10% para não sincronizar os DAOs dos nós.
+    m_daoEvent = Simulator::Schedule(Seconds(m_daoInterval.GetSeconds() * m_rng->GetValue(0.9, 1.0)), &RplRouter::RefreshDao, this);
+}
+
+// Coleta a latência de cada pacote UDP/TCP durante a execução, ligada aos traces SendOutgoing e
+// LocalDeliver do IPv6, em um histograma por fluxo (endereços, portas e protocolo) e um por nó de
+// origem. Os percentis e histogramas são gravados periodicamente, sem guardar os pacotes.
+class LatencyCollector {
+public:
+    // Liga os traces da camada IPv6 de todos os nós.
+    void Install(const NodeContainer& nodes);
+    // Abre os arquivos de saída e agenda um snapshot a cada interval (0 = apenas no fim).
+    void Start(const std::string& outputDir, Time interval);
+    // Grava o snapshot final e fecha os arquivos.
+    void Finish();
+    // Ignora os pacotes com esta porta de origem ou destino (ex.: controle do roteamento).
+    void IgnorePort(uint16_t port) { m_ignoredPorts.insert(port); }
+    // Grava também cada pacote enviado e entregue no packets.bin, com os nomes dos fluxos no
+    // packet_flows.csv. Chamar antes de Start.
+    bool EnablePacketTrace(const std::string& outputDir);
+    uint64_t GetPacketTraceRecords() const { return m_trace.GetRecordCount(); }
+    // A cada interval, acrescenta ao kpi.csv a vazão, a taxa de entrega e o atraso só dos pacotes
+    // daquela janela. Com precision > 0, encerra a simulação quando o intervalo de confiança de 95%
+    // das médias das janelas dos três fica dentro dessa fração da média, depois de pelo menos
+    // minWindows janelas com tráfego. Chamar antes de Start.
+    bool EnableKpi(const std::string& outputDir, Time interval, double precision, uint32_t minWindows);
+    // Instante em que os KPIs convergiram e a simulação foi encerrada (zero se foi até o fim).
+    Time GetConvergenceTime() const { return m_convergedAt; }
+    // Totais da execução: pacotes enviados pela aplicação e atraso de todos os entregues.
+    uint64_t GetTxPackets() const { return m_totalTx; }
+    const LatencyHistogram& GetTotalLatency() const { return m_total; }
+    // Chamado com o atraso (ns) de cada pacote entregue (ex.: gatilho da captura PCAP).
+    void SetLatencyCallback(Callback<void, int64_t> callback) { m_latencyCallback = callback; }
+private:
+    // Média e variância de um KPI ao longo das janelas (Welford), com a meia-largura relativa do
+    // intervalo de confiança de 95% (cada janela é uma média de lote).
+    struct KpiStats {
+        uint32_t n = 0;
+        double mean = 0.0;
+        double m2 = 0.0;
+        void Add(double x) {
+            n++;
+            double d = x - mean;
+            mean += d / n;
+            m2 += d * (x - mean);
+        }
+        double RelativeHalfWidth() const {
+            if (n < 2) {
+                return std::numeric_limits<double>::infinity();
+            }
+            double half = 1.96 * std::sqrt(m2 / (n - 1) / n);
+            if (mean == 0.0) {
+                return half == 0.0 ? 0.0 : std::numeric_limits<double>::infinity();
+            }
+            return half / std::abs(mean);
+        }
+    };
+    void KpiWindow();
+    struct FlowKey {
+        Ipv6Address source;
+        Ipv6Address destination;
+        uint16_t sourcePort;
+        uint16_t destinationPort;
+        uint8_t protocol;
+        bool operator<(const FlowKey& o) const {
+            if (source != o.source) return source < o.source;
+            if (destination != o.destination) return destination < o.destination;
+            if (sourcePort != o.sourcePort) return sourcePort < o.sourcePort;
+            if (destinationPort != o.destinationPort) return destinationPort < o.destinationPort;
+            return protocol < o.protocol;
+        }
+    };
+    static void SendOutgoing(LatencyCollector* collector, uint32_t nodeId, const Ipv6Header& header,
+                             Ptr<const Packet> packet, uint32_t interface);
+    static void LocalDeliver(LatencyCollector* collector, uint32_t nodeId, const Ipv6Header& header,
+                             Ptr<const Packet> packet, uint32_t interface);
+    // Fluxo de um pacote UDP/TCP (criado se for novo); falso se alguma porta for ignorada.
+    bool GetFlowIndex(const Ipv6Header& header, Ptr<const Packet> packet, uint32_t& index);
+    void Snapshot();
+    void WriteHistogram(const std::string& scope, const std::string& key, const LatencyHistogram& histogram);
+
+    std::map<FlowKey, uint32_t> m_flowIds;  // Fluxo -> índice em m_flows.
+    std::vector<LatencyHistogram> m_flows;
+    std::vector<std::string> m_flowNames;  // "[origem]:porta->[destino]:porta/protocolo".
+    std::vector<uint8_t> m_flowDscp;  // DSCP (6 bits mais altos do Traffic Class) de cada fluxo.
+    std::map<uint32_t, LatencyHistogram> m_nodes;  // Por nó de origem.
+    LatencyHistogram m_total;  // Todos os pacotes entregues.
+    uint64_t m_totalTx = 0;
+    std::set<uint16_t> m_ignoredPorts;
+    std::ofstream m_percentiles;  // latency_percentiles.csv
+    std::ofstream m_histograms;  // latency_histograms.csv
+    Time m_interval;
+    PacketTrace m_trace;  // packets.bin
+    std::string m_traceFlowsPath;  // packet_flows.csv
+    std::ofstream m_kpi;  // kpi.csv
+    Time m_kpiInterval;
+    double m_kpiPrecision = 0.0;
+    uint32_t m_kpiMinWindows = 0;
+    uint64_t m_windowTx = 0;  // Pacotes da janela atual.
+    uint64_t m_windowRx = 0;
+    uint64_t m_windowRxBytes = 0;
+    LatencyHistogram m_window;
+    KpiStats m_throughput;
+    KpiStats m_delivery;
+    KpiStats m_delay;
+    Time m_convergedAt;
+    Callback<void, int64_t> m_latencyCallback;
+};
+
+void LatencyCollector::Install(const NodeContainer& nodes) {
+    for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+        Ptr<Node> node = nodes.Get(i);
+        Ptr<Ipv6L3Protocol> ipv6 = node->GetObject<Ipv6L3Protocol>();
+        ipv6->TraceConnectWithoutContext("SendOutgoing", MakeBoundCallback(&LatencyCollector::SendOutgoing, this, node->GetId()));
+        ipv6->TraceConnectWithoutContext("LocalDeliver", MakeBoundCallback(&LatencyCollector::LocalDeliver, this, node->GetId()));
+    }
+}
+
+void LatencyCollector::Start(const std::string& outputDir, Time interval) {
+    m_interval = interval;
+    m_percentiles.open(outputDir + "/latency_percentiles.csv", std::ios::trunc);
+    m_percentiles << "Time,Scope,Key,Count,Mean(ms),P50(ms),P90(ms),P99(ms),P99.9(ms),Max(ms),Jitter(ms)\n";
+    m_histograms.open(outputDir + "/latency_histograms.csv", std::ios::trunc);
+    m_histograms << "Time,Scope,Key,BucketLow(ms),BucketHigh(ms),Count\n";
+    if (m_interval.IsStrictlyPositive()) {
+        Simulator::Schedule(m_interval, &LatencyCollector::Snapshot, this);
+    }
+}
+
+bool LatencyCollector::EnablePacketTrace(const std::string& outputDir) {
+    m_traceFlowsPath = outputDir + "/packet_flows.csv";
+    return m_trace.Open(outputDir + "/packets.bin", 4096);
+}
+
+bool LatencyCollector::EnableKpi(const std::string& outputDir, Time interval, double precision, uint32_t minWindows) {
+    m_kpi.open(outputDir + "/kpi.csv", std::ios::trunc);
+    if (!m_kpi.is_open()) {
+        NS_LOG_ERROR("Failed to open " << outputDir << "/kpi.csv for writing");
+        return false;
+    }
+    m_kpi << "Time,TxPackets,RxPackets,DeliveryRatio,Throughput(kbps),MeanDelay(ms),P50(ms),P99(ms),"
+          << "ThroughputCI,DeliveryCI,DelayCI\n";
+    m_kpiInterval = interval;
+    m_kpiPrecision = precision;
+    m_kpiMinWindows = std::max<uint32_t>(minWindows, 2);
+    Simulator::Schedule(m_kpiInterval, &LatencyCollector::KpiWindow, this);
+    return true;
+}
+
+// Grava os KPIs da janela que terminou e verifica se convergiram.
+void LatencyCollector::KpiWindow() {
+    double throughput = m_windowRxBytes * 8.0 / m_kpiInterval.GetSeconds() / 1e3;
+    double delivery = m_windowTx ? static_cast<double>(m_windowRx) / m_windowTx : 0.0;
+    double delayMs = m_window.GetMeanNs() / 1e6;
+    // Janelas sem tráfego (formação da rede, antes de appStart) não entram nas estatísticas.
+    if (m_windowTx > 0) {
+        m_throughput.Add(throughput);
+        m_delivery.Add(delivery);
+        if (m_windowRx > 0) {
+            m_delay.Add(delayMs);
+        }
+    }
+    double throughputCi = m_throughput.RelativeHalfWidth();
+    double deliveryCi = m_delivery.RelativeHalfWidth();
+    double delayCi = m_delay.RelativeHalfWidth();
+    m_kpi << Simulator::Now().GetSeconds() << "," << m_windowTx << "," << m_windowRx << "," << delivery << ","
+          << throughput << "," << delayMs << "," << m_window.GetPercentileNs(50) / 1e6 << ","
+          << m_window.GetPercentileNs(99) / 1e6 << "," << throughputCi << "," << deliveryCi << "," << delayCi << "\n";
+    m_kpi.flush();
+    m_windowTx = m_windowRx = m_windowRxBytes = 0;
+    m_window = LatencyHistogram();
+    if (m_kpiPrecision > 0 && m_throughput.n >= m_kpiMinWindows &&
+        std::max({throughputCi, deliveryCi, delayCi}) <= m_kpiPrecision) {
+        m_convergedAt = Simulator::Now();
+        Simulator::Stop();
+        return;
+    }
+    Simulator::Schedule(m_kpiInterval, &LatencyCollector::KpiWindow, this);
+}
+
+void LatencyCollector::SendOutgoing(LatencyCollector* collector, uint32_t nodeId, const Ipv6Header& header,
+                                    Ptr<const Packet> packet, uint32_t interface) {
+    uint8_t protocol = header.GetNextHeader();
+    if (protocol == UdpL4Protocol::PROT_NUMBER || protocol == TcpL4Protocol::PROT_NUMBER) {
+        LatencyTag tag;
+        tag.Set(Simulator::Now(), nodeId);
+        packet->AddByteTag(tag);
+        // Conta o envio só nos fluxos da aplicação (sem as portas ignoradas).
+        uint32_t flow;
+        if (packet->GetSize() >= 4 && collector->GetFlowIndex(header, packet, flow)) {
+            collector->m_totalTx++;
+            collector->m_windowTx++;
+            if (collector->m_trace.IsOpen()) {
+                collector->m_trace.Append(Simulator::Now().GetNanoSeconds(), -1, flow, nodeId,
+                                          packet->GetSize() + header.GetSerializedSize());
+            }
+        }
+    }
+}
+
+bool LatencyCollector::GetFlowIndex(const Ipv6Header& header, Ptr<const Packet> packet, uint32_t& index) {
+    // As portas são os 4 primeiros bytes dos cabeçalhos UDP e TCP.
+    uint8_t ports[4];
+    packet->CopyData(ports, 4);
+    FlowKey key{header.GetSource(), header.GetDestination(), static_cast<uint16_t>((ports[0] << 8) | ports[1]),
+                static_cast<uint16_t>((ports[2] << 8) | ports[3]), header.GetNextHeader()};
+    if (!m_ignoredPorts.empty() && (m_ignoredPorts.count(key.sourcePort) || m_ignoredPorts.count(key.destinationPort))) {
+        return false;
+    }
+    auto flow = m_flowIds.find(key);
+    if (flow == m_flowIds.end()) {
+        std::ostringstream name;
+        name << "[" << key.source << "]:" << key.sourcePort << "->[" << key.destination << "]:" << key.destinationPort
+             << "/" << (key.protocol == TcpL4Protocol::PROT_NUMBER ? "TCP" : "UDP");
+        flow = m_flowIds.emplace(key, m_flows.size()).first;
+        m_flows.emplace_back();
+        m_flowNames.push_back(name.str());
+        m_flowDscp.push_back(header.GetTrafficClass() >> 2);
+    }
+    index = flow->second;
+    return true;
+}
+
+void LatencyCollector::LocalDeliver(LatencyCollector* collector, uint32_t nodeId, const Ipv6Header& header,
+                                    Ptr<const Packet> packet, uint32_t interface) {
+    uint8_t protocol = header.GetNextHeader();
+    if ((protocol != UdpL4Protocol::PROT_NUMBER && protocol != TcpL4Protocol::PROT_NUMBER) || packet->GetSize() < 4) {
+        return;
+    }
+    // Usa a tag mais recente (uma retransmissão TCP pode carregar bytes já marcados antes).
+    LatencyTag tag;
+    bool found = false;
+    ByteTagIterator it = packet->GetByteTagIterator();
+    while (it.HasNext()) {
+        ByteTagIterator::Item item = it.Next();
+        if (item.GetTypeId() == LatencyTag::GetTypeId()) {
+            LatencyTag candidate;
+            item.GetTag(candidate);
+            if (!found || candidate.GetTime() > tag.GetTime()) {
+                tag = candidate;
+                found = true;
+            }
+        }
+    }
+    uint32_t flow;
+    if (!found || !collector->GetFlowIndex(header, packet, flow)) {
+        return;
+    }
+    int64_t latencyNs = (Simulator::Now() - tag.GetTime()).GetNanoSeconds();
+    collector->m_flows[flow].Record(latencyNs);
+    collector->m_nodes[tag.GetNodeId()].Record(latencyNs);
+    uint32_t bytes = packet->GetSize() + header.GetSerializedSize();
+    collector->m_total.Record(latencyNs);
+    collector->m_windowRx++;
+    collector->m_windowRxBytes += bytes;
+    collector->m_window.Record(latencyNs);
+    if (collector->m_trace.IsOpen()) {
+        collector->m_trace.Append(Simulator::Now().GetNanoSeconds(), latencyNs, flow, tag.GetNodeId(), bytes);
+    }
+    if (!collector->m_latencyCallback.IsNull()) {
+        collector->m_latencyCallback(latencyNs);
+    }
+}
+
+void LatencyCollector::WriteHistogram(const std::string& scope, const std::string& key, const LatencyHistogram& histogram) {
+    if (histogram.GetCount() == 0) {
+        return;
+    }
+    double now = Simulator::Now().GetSeconds();
+    m_percentiles << now << "," << scope << "," << key << "," << histogram.GetCount() << ","
+                  << histogram.GetMeanNs() / 1e6 << "," << histogram.GetPercentileNs(50) / 1e6 << ","
+                  << histogram.GetPercentileNs(90) / 1e6 << "," << histogram.GetPercentileNs(99) / 1e6 << ","
+                  << histogram.GetPercentileNs(99.9) / 1e6 << "," << histogram.GetMaxNs() / 1e6 << ","
+                  << histogram.GetJitterNs() / 1e6 << "\n";
+    const std::vector<uint32_t>& buckets = histogram.GetBuckets();
+    for (uint32_t i = 0; i < buckets.size(); ++i) {
+        if (buckets[i] > 0) {
+            m_histograms << now << "," << scope << "," << key << "," << LatencyHistogram::BucketLow(i) / 1e6 << ","
+                         << LatencyHistogram::BucketHigh(i) / 1e6 << "," << buckets[i] << "\n";
+        }
+    }
+}
+
+// Grava os percentis e histogramas acumulados até agora, por fluxo e por nó.
+void LatencyCollector::Snapshot() {
+    for (uint32_t i = 0; i < m_flows.size(); ++i) {
+        WriteHistogram("flow", m_flowNames[i], m_flows[i]);
+    }
+    for (const auto& node : m_nodes) {
+        WriteHistogram("node", std::to_string(node.first), node.second);
+    }
+    m_percentiles.flush();
+    m_histograms.flush();
+    if (m_interval.IsStrictlyPositive()) {
+        Simulator::Schedule(m_interval, &LatencyCollector::Snapshot, this);
+    }
+}
+
+void LatencyCollector::Finish() {
+    m_interval = Time();  // Não reagenda.
+    Snapshot();
+    m_percentiles.close();
+    m_histograms.close();
+    m_kpi.close();
+    if (m_trace.IsOpen()) {
+        m_trace.Close();
+        std::ofstream flows(m_traceFlowsPath, std::ios::trunc);
+        flows << "Flow,Name,DSCP\n";
+        for (uint32_t i = 0; i < m_flowNames.size(); ++i) {
+            flows << i << "," << m_flowNames[i] << "," << static_cast<uint32_t>(m_flowDscp[i]) << "\n";
+        }
+    }
+}
 
-// Função para inicializar o arquivo CSV onde os logs serão salvos.
-void InitializeLogCsv() {
-    // Abre o arquivo logs.csv no diretório /ns-3-dev/output, sobrescrevendo se já existir (std::ios::trunc).
-    logCsvFile.open("/ns-3-dev/output/logs.csv", std::ios::trunc);
-    if (!logCsvFile.is_open()) {
-        // Se o arquivo não puder ser aberto, registra um erro no log do terminal.
-        NS_LOG_ERROR("Failed to open logs.csv for writing");
+// Estados de consumo do rádio LR-WPAN, agrupando os estados do LrWpanPhy.
+enum RadioEnergyState : uint8_t {
+    RADIO_OFF = 0,   // TRX_OFF: transceptor desligado (sono com duty cycling).
+    RADIO_IDLE = 1,  // RX_ON sem quadro: escuta ociosa, CCA e backoff do CSMA/CA.
+    RADIO_RX = 2,    // BUSY_RX: recebendo um quadro.
+    RADIO_TX = 3,    // TX_ON/BUSY_TX: transmitindo.
+    RADIO_STATES = 4,
+};
+
+const char* RadioEnergyStateName(uint8_t state) {
+    switch (state) {
+        case RADIO_OFF: return "Off";
+        case RADIO_IDLE: return "Idle";
+        case RADIO_RX: return "Rx";
+        case RADIO_TX: return "Tx";
+    }
+    return "Unknown";
+}
+
+// Modelo de energia do rádio LR-WPAN para o framework de energia do ns-3: acompanha o trace
+// TrxStateValue do LrWpanPhy e desconta da fonte (BasicEnergySource) a corrente de cada estado,
+// guardando o tempo e a energia acumulados por estado.
+class LrWpanRadioEnergyModel : public energy::DeviceEnergyModel {
+public:
+    LrWpanRadioEnergyModel();
+    // Correntes (A) nos estados RADIO_OFF, RADIO_IDLE, RADIO_RX e RADIO_TX.
+    void SetCurrents(double offA, double idleA, double rxA, double txA);
+    // Liga o modelo ao PHY do dispositivo e o registra na fonte de energia do nó.
+    void Attach(Ptr<lrwpan::LrWpanNetDevice> device, Ptr<energy::EnergySource> source, uint32_t nodeId);
+    // Chamado quando a bateria se esgota (ex.: para desligar a aplicação do sensor).
+    void SetDepletionCallback(Callback<void> callback) { m_depletionCallback = callback; }
+    // Tempo (s) e energia (J) acumulados em um estado, incluindo o estado atual até agora.
+    double GetStateTime(uint8_t state) const;
+    double GetStateEnergy(uint8_t state) const;
+    bool IsDepleted() const { return m_depleted; }
+    Time GetDepletionTime() const { return m_depletionTime; }
+
+    // Interface de DeviceEnergyModel.
+    void SetEnergySource(Ptr<energy::EnergySource> source) override { m_source = source; }
+    double GetTotalEnergyConsumption() const override;
+    void ChangeState(int newState) override;
+    void HandleEnergyDepletion() override;
+    void HandleEnergyRecharged() override {}
+    void HandleEnergyChanged() override {}
+private:
+    double DoGetCurrentA() const override { return m_currentA[m_state]; }
+    void TrxStateChanged(lrwpan::PhyEnumeration oldState, lrwpan::PhyEnumeration newState);
+    // Desliga o rádio após o esgotamento da bateria (fora do contexto da atualização da fonte).
+    void PowerDown();
+    // Tempo no estado atual desde a última mudança de estado.
+    double ElapsedSeconds() const { return (Simulator::Now() - m_lastUpdate).GetSeconds(); }
+
+    Ptr<energy::EnergySource> m_source;
+    Ptr<lrwpan::LrWpanNetDevice> m_device;
+    uint32_t m_nodeId;
+    double m_currentA[RADIO_STATES];
+    uint8_t m_state;  // Estado atual (RadioEnergyState).
+    Time m_lastUpdate;  // Instante da última mudança de estado.
+    double m_stateTime[RADIO_STATES];  // s
+    double m_stateEnergy[RADIO_STATES];  // J
+    bool m_depleted;
+    Time m_depletionTime;
+    Callback<void> m_depletionCallback;
+};
+
+// Correntes padrão do CC2420 a 3 V (datasheet): RX/escuta 18,8 mA, TX a 0 dBm 17,4 mA,
+// oscilador ligado com o transceptor desligado 426 uA.
+LrWpanRadioEnergyModel::LrWpanRadioEnergyModel()
+    : m_nodeId(0),
+      m_currentA{0.000426, 0.0188, 0.0188, 0.0174},
+      m_state(RADIO_OFF),
+      m_stateTime{},
+      m_stateEnergy{},
+      m_depleted(false) {}
+
+void LrWpanRadioEnergyModel::SetCurrents(double offA, double idleA, double rxA, double txA) {
+    m_currentA[RADIO_OFF] = offA;
+    m_currentA[RADIO_IDLE] = idleA;
+    m_currentA[RADIO_RX] = rxA;
+    m_currentA[RADIO_TX] = txA;
+}
+
+void LrWpanRadioEnergyModel::Attach(Ptr<lrwpan::LrWpanNetDevice> device, Ptr<energy::EnergySource> source, uint32_t nodeId) {
+    m_device = device;
+    m_nodeId = nodeId;
+    m_lastUpdate = Simulator::Now();
+    SetEnergySource(source);
+    source->AppendDeviceEnergyModel(this);
+    device->GetPhy()->TraceConnectWithoutContext("TrxStateValue", MakeCallback(&LrWpanRadioEnergyModel::TrxStateChanged, this));
+}
+
+void LrWpanRadioEnergyModel::TrxStateChanged(lrwpan::PhyEnumeration oldState, lrwpan::PhyEnumeration newState) {
+    switch (newState) {
+        case lrwpan::IEEE_802_15_4_PHY_TRX_OFF:
+        case lrwpan::IEEE_802_15_4_PHY_FORCE_TRX_OFF:
+            ChangeState(RADIO_OFF);
+            break;
+        case lrwpan::IEEE_802_15_4_PHY_RX_ON:
+            ChangeState(RADIO_IDLE);
+            break;
+        case lrwpan::IEEE_802_15_4_PHY_BUSY_RX:
+            ChangeState(RADIO_RX);
+            break;
+        case lrwpan::IEEE_802_15_4_PHY_TX_ON:
+        case lrwpan::IEEE_802_15_4_PHY_BUSY_TX:
+            ChangeState(RADIO_TX);
+            break;
+        default:
+            break;  // Estados transitórios não mudam o consumo.
+    }
+}
+
+void LrWpanRadioEnergyModel::ChangeState(int newState) {
+    if (newState == m_state) {
         return;
     }
-    // Escreve o cabeçalho do CSV com as colunas: Timestamp, NodeID, Event e Details.
-    logCsvFile << "Timestamp,NodeID,Event,Details\n";
+    // Contabiliza o estado anterior; a fonte também é atualizada com a corrente anterior.
+    double seconds = ElapsedSeconds();
+    double joules = seconds * m_currentA[m_state] * m_source->GetSupplyVoltage();
+    m_stateTime[m_state] += seconds;
+    m_stateEnergy[m_state] += joules;
+    m_lastUpdate = Simulator::Now();
+    m_source->UpdateEnergySource();
+    m_state = static_cast<uint8_t>(newState);
+}
+
+double LrWpanRadioEnergyModel::GetStateTime(uint8_t state) const {
+    return m_stateTime[state] + (state == m_state ? ElapsedSeconds() : 0.0);
+}
+
+double LrWpanRadioEnergyModel::GetStateEnergy(uint8_t state) const {
+    double current = state == m_state && m_source ? ElapsedSeconds() * m_currentA[state] * m_source->GetSupplyVoltage() : 0.0;
+    return m_stateEnergy[state] + current;
+}
+
+double LrWpanRadioEnergyModel::GetTotalEnergyConsumption() const {
+    double total = 0.0;
+    for (uint8_t state = 0; state < RADIO_STATES; ++state) {
+        total += GetStateEnergy(state);
+    }
+    return total;
 }
 
-// Função para escrever uma entrada no arquivo CSV.
-void WriteToLogCsv(double timestamp, uint32_t nodeId, const std::string& event, const std::string& details) {
-    // Verifica se o arquivo CSV está aberto; se não estiver, registra um erro e retorna.
-    if (!logCsvFile.is_open()) {
-        NS_LOG_ERROR("logs.csv is not open for writing");
+void LrWpanRadioEnergyModel::HandleEnergyDepletion() {
+    if (m_depleted) {
         return;
     }
-    std::stringstream ss;  // Cria um stringstream para formatar a linha do CSV.
-    // Formata a linha com o timestamp (com 6 casas decimais), o ID do nó, o evento e os detalhes.
-    // Os detalhes são colocados entre aspas para lidar com possíveis vírgulas no conteúdo.
-    ss << std::fixed << std::setprecision(6) << timestamp << "," 
-       << nodeId << "," 
-       << event << "," 
-       << "\"" << details << "\"\n";
-    // Escreve a linha formatada no arquivo CSV.
-    logCsvFile << ss.str();
-    // Garante que o conteúdo seja escrito no arquivo imediatamente, evitando perda de dados.
-    logCsvFile.flush();
+    m_depleted = true;
+    m_depletionTime = Simulator::Now();
+    LogEnergyDepleted(m_nodeId, GetTotalEnergyConsumption());
+    Simulator::ScheduleNow(&LrWpanRadioEnergyModel::PowerDown, this);
+}
+
+void LrWpanRadioEnergyModel::PowerDown() {
+    if (!m_depletionCallback.IsNull()) {
+        m_depletionCallback();
+    }
+    m_device->GetMac()->SetRxOnWhenIdle(false);
+    m_device->GetPhy()->PlmeSetTRXStateRequest(lrwpan::IEEE_802_15_4_PHY_FORCE_TRX_OFF);
 }
 
-// Função para fechar o arquivo CSV.
-void CloseLogCsv() {
-    // Verifica se o arquivo está aberto e, se estiver, fecha-o.
-    if (logCsvFile.is_open()) {
-        logCsvFile.close();
+// Micro-benchmark do caminho de montagem das publicações, fora da simulação: compara o caminho antigo
+// (snprintf + new[] + memcpy + Packet + delete[]) com a codificação em buffer reutilizado nos formatos
+// texto e binário. O registro no log de eventos fica fora dos três caminhos, para que só a montagem
+// seja comparada. Imprime publicações/s de tempo de relógio de cada caminho e o checksum dos pacotes.
+void RunPayloadBenchmark(uint64_t iterations) {
+    std::vector<uint8_t> frame(128);
+    uint8_t payload[SENSOR_PAYLOAD_MAX];
+    uint64_t checksum = 0;  // Impresso no fim, para que o compilador não descarte os laços.
+    auto report = [iterations](const char* name, std::chrono::steady_clock::time_point start) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(0)
+                  << iterations / seconds << " publishes/s (" << std::setprecision(1) << 1e9 * seconds / iterations
+                  << " ns/publish)" << std::endl;
+    };
+    std::cout << "Payload benchmark: " << iterations << " publishes per path" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        char message[32];
+        double temp = 20.0 + (i % 100) / 10.0;
+        int hum = 50 + static_cast<int>(i % 30);
+        snprintf(message, sizeof(message), "Temp: %.1f C, Hum: %d%%", temp, hum);
+        uint32_t length = strlen(message) + 1;
+        uint8_t* buffer = new uint8_t[length];
+        memcpy(buffer, message, length);
+        Ptr<Packet> packet = Create<Packet>(buffer, length);
+        delete[] buffer;
+        checksum += packet->GetSize();
+    }
+    report("legacy", start);
+
+    const PayloadFormat formats[] = {PayloadFormat::TEXT, PayloadFormat::BINARY};
+    const char* names[] = {"text", "binary"};
+    for (int f = 0; f < 2; ++f) {
+        start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            MqttSnMessage pub;
+            pub.type = MQTTSN_PUBLISH;
+            pub.topicId = 1;
+            pub.msgId = static_cast<uint16_t>(i);
+            pub.data = payload;
+            pub.dataLength = EncodeSensorPayload(formats[f], i, static_cast<int16_t>(200 + i % 100),
+                                                 static_cast<uint8_t>(50 + i % 30), payload);
+            uint32_t length = EncodeMqttSn(pub, frame.data(), frame.size());
+            Ptr<Packet> packet = Create<Packet>(frame.data(), length);
+            checksum += packet->GetSize();
+        }
+        report(names[f], start);
     }
+    std::cout << "  checksum " << checksum << std::endl;
 }
 
-// Declaração da classe MqttPublisher, que herda de Application para simular um publisher MQTT.
-class MqttPublisher : public Application {
+// Conta os quadros transmitidos pelos rádios LrWpan (trace PhyTxBegin) e estima o tempo no ar
+// a 250 kbps (2,4 GHz O-QPSK), incluindo os 6 bytes do cabeçalho de sincronização e do PHY.
+class AirtimeCounter {
 public:
-    MqttPublisher();  // Construtor.
-    virtual ~MqttPublisher();  // Destrutor.
-    // Função para configurar o aplicativo com endereço de destino, porta e ID do nó.
-    void Setup(Ipv6Address address, uint16_t port, uint32_t nodeId);
-    // Função para lidar com pacotes recebidos pelo socket.
-    void HandleReceive(Ptr<Socket> socket);
-    // Métodos para obter o número de pacotes enviados e recebidos.
-    uint32_t GetPacketsSent() const { return m_packetCount; }
-    uint32_t GetPacketsReceived() const { return m_packetsReceived; }
+    void PhyTxBegin(Ptr<const Packet> packet) {
+        m_frames++;
+        m_bytes += packet->GetSize();
+    }
+    uint64_t GetFrames() const { return m_frames; }
+    uint64_t GetBytes() const { return m_bytes; }
+    Time GetAirtime() const { return MicroSeconds((m_bytes + 6 * m_frames) * 8 * 4); }  // 4 us por bit.
 private:
-    // Funções virtuais sobrescritas de Application para iniciar e parar a aplicação.
-    virtual void StartApplication(void);
-    virtual void StopApplication(void);
-    // Função para o gateway enviar uma resposta (ACK) ao nó sensor que enviou um pacote.
-    void SendResponse(Ptr<Socket> socket, Ipv6Address sourceAddr, uint16_t sourcePort);
-    Ipv6Address m_peerAddress;  // Endereço IPv6 do destino (gateway para sensores, ou "any" para o gateway).
-    uint16_t m_port;  // Porta de comunicação (1883 para MQTT).
-    Ptr<Socket> m_socket;  // Socket UDP para envio e recebimento de pacotes.
-    uint32_t m_nodeId;  // ID do nó (0-9 para sensores, 10 para gateway).
-    uint32_t m_packetCount;  // Contador de pacotes enviados pelo nó.
-    uint32_t m_packetsReceived;  // Contador de pacotes recebidos pelo nó.
-    bool m_running;  // Flag para indicar se a aplicação está ativa.
-    static const uint32_t MAX_PACKETS = 10;  // Número máximo de pacotes que cada nó pode enviar.
+    uint64_t m_frames = 0;
+    uint64_t m_bytes = 0;
 };
 
-// Construtor: inicializa variáveis com valores padrão.
-MqttPublisher::MqttPublisher() 
-    : m_port(0), 
-      m_socket(0), 
-      m_nodeId(0), 
-      m_packetCount(0), 
-      m_packetsReceived(0), 
-      m_running(false) {}
-
-// Destrutor: limpa o socket (seta como nulo para evitar dangling pointers).
-MqttPublisher::~MqttPublisher() { 
-    m_socket = 0; 
+// Conjunto de nós de --pcapNodes: vazio (nenhum), "all" ou IDs e intervalos separados por vírgula
+// (ex.: "0,3,10-19").
+bool ParseNodeSet(const std::string& spec, std::set<uint32_t>& nodes, bool& all) {
+    nodes.clear();
+    all = spec == "all";
+    if (all || spec.empty()) {
+        return true;
+    }
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        char* end = nullptr;
+        unsigned long first = std::strtoul(item.c_str(), &end, 10);
+        if (end == item.c_str()) {
+            return false;
+        }
+        unsigned long last = first;
+        if (*end == '-') {
+            const char* from = end + 1;
+            last = std::strtoul(from, &end, 10);
+            if (end == from || last < first) {
+                return false;
+            }
+        }
+        if (*end != '\0') {
+            return false;
+        }
+        for (unsigned long node = first; node <= last; ++node) {
+            nodes.insert(static_cast<uint32_t>(node));
+        }
+    }
+    return true;
 }
 
-// Configura o aplicativo com o endereço de destino, porta e ID do nó.
-void MqttPublisher::Setup(Ipv6Address address, uint16_t port, uint32_t nodeId) {
-    m_peerAddress = address;  // Endereço do gateway (ou "any" para o gateway).
-    m_port = port;  // Porta MQTT (1883).
-    m_nodeId = nodeId;  // ID do nó (0-9 para sensores, 10 para gateway).
+// Captura PCAP seletiva dos quadros LR-WPAN (trace Sniffer do MAC, o mesmo do EnablePcap do
+// LrWpanHelper): só os dispositivos dos nós escolhidos, um a cada sample quadros de cada
+// dispositivo, com no máximo snaplen bytes por quadro e dentro de uma janela de tempo. Com o
+// gatilho de atraso, os quadros ficam em memória por triggerWindow e só vão para o arquivo quando
+// um pacote é entregue com atraso acima do limite (os de antes e os de depois do disparo). Cada
+// arquivo tem um buffer próprio, gravado quando enche, e pode passar por um gzip externo.
+class PcapCapture {
+public:
+    struct Config {
+        uint32_t sample = 1;  // Grava um a cada sample quadros de cada dispositivo.
+        uint32_t snaplen = 0;  // Bytes gravados por quadro (0 = o quadro inteiro).
+        Time start;
+        Time stop;  // Zero = até o fim da simulação.
+        int64_t latencyNs = 0;  // Atraso fim a fim que dispara a gravação (0 = grava sempre).
+        Time triggerWindow;  // Quadros gravados antes e depois de cada disparo.
+        uint32_t bufferBytes = 1 << 20;  // Buffer de cada arquivo.
+        bool compress = false;  // Grava prefix-<nó>-<dispositivo>.pcap.gz via gzip.
+    };
+    ~PcapCapture() { Close(); }
+    void Configure(const Config& config) { m_config = config; }
+    // Abre prefix-<nó>-<dispositivo>.pcap para cada dispositivo dos nós escolhidos (todos com
+    // allNodes) e liga o trace Sniffer do MAC.
+    bool Attach(const std::string& prefix, const NetDeviceContainer& devices, const std::set<uint32_t>& nodes, bool allNodes);
+    // Atraso de um pacote entregue (LatencyCollector); dispara a gravação se passar do limite.
+    void Latency(int64_t latencyNs);
+    // Grava os buffers e fecha os arquivos (espera o gzip terminar).
+    void Close();
+    bool IsEnabled() const { return !m_files.empty(); }
+    uint32_t GetFileCount() const { return m_files.size(); }
+    uint64_t GetFramesSeen() const { return m_framesSeen; }
+    uint64_t GetFramesWritten() const { return m_framesWritten; }
+    uint64_t GetTriggers() const { return m_triggers; }
+    uint64_t GetBytesWritten() const { return m_bytesWritten; }  // Antes da compressão.
+    uint64_t GetDiskBytes() const { return m_diskBytes; }  // Tamanho final dos arquivos.
+    uint32_t GetFailedFiles() const { return m_failedFiles; }  // Com erro de escrita ou gzip com falha.
+    double GetWallSeconds() const { return m_wallNs / 1e9; }  // No trace, nos buffers e no Close.
+private:
+    struct Frame {
+        int64_t timeNs;
+        uint32_t origLen;
+        std::vector<uint8_t> data;
+    };
+    struct File {
+        std::string path;
+        std::FILE* file = nullptr;
+        pid_t gzip = -1;  // Processo gzip que lê o pipe file (--pcapCompress).
+        bool failed = false;  // Escrita incompleta.
+        std::vector<uint8_t> buffer;
+        uint64_t seen = 0;  // Quadros na janela de captura, para a amostragem.
+        std::deque<Frame> pending;  // Últimos triggerWindow de quadros, à espera de um disparo.
+    };
+    static void Sniff(PcapCapture* capture, File* file, Ptr<const Packet> packet);
+    void Write(File& file, int64_t timeNs, uint32_t origLen, const uint8_t* data, uint32_t length);
+    void Flush(File& file);
+    // Inicia um gzip que comprime o que for escrito no FILE* retornado para path.
+    static std::FILE* OpenGzip(const std::string& path, pid_t& pid);
+
+    Config m_config;
+    std::vector<std::unique_ptr<File>> m_files;
+    std::vector<uint8_t> m_frame;  // Bytes do quadro sendo capturado.
+    int64_t m_triggeredUntilNs = -1;
+    uint64_t m_framesSeen = 0;
+    uint64_t m_framesWritten = 0;
+    uint64_t m_triggers = 0;
+    uint64_t m_bytesWritten = 0;
+    uint64_t m_diskBytes = 0;
+    uint32_t m_failedFiles = 0;
+    uint64_t m_wallNs = 0;
+};
+
+// O gzip é iniciado sem shell (o caminho vem de --outputDir) e recebe só as pontas do seu pipe e do
+// seu arquivo: os descritores são close-on-exec, para que um gzip não herde o pipe de outro e
+// deixe de ver o fim dos dados.
+std::FILE* PcapCapture::OpenGzip(const std::string& path, pid_t& pid) {
+    int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        return nullptr;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        close(out);
+        return nullptr;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    char* argv[] = {const_cast<char*>("gzip"), const_cast<char*>("-c"), nullptr};
+    int error = posix_spawnp(&pid, "gzip", &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+    close(out);
+    if (error != 0) {
+        close(fds[1]);
+        return nullptr;
+    }
+    return fdopen(fds[1], "wb");
 }
 
-// Função para lidar com pacotes recebidos.
-void MqttPublisher::HandleReceive(Ptr<Socket> socket) {
-    Ptr<Packet> packet;  // Ponteiro para o pacote recebido.
-    Address from;  // Endereço de origem do pacote.
-    // Loop para processar todos os pacotes disponíveis no socket.
-    while ((packet = socket->RecvFrom(from))) {
-        m_packetsReceived++;  // Incrementa o contador de pacotes recebidos.
-        // Registra o evento no CSV.
-        std::stringstream details;  // Cria um stringstream para formatar os detalhes.
-        details << "Size: " << packet->GetSize();  // Detalhe: tamanho do pacote.
-        WriteToLogCsv(Simulator::Now().GetSeconds(), m_nodeId, "Received Packet", details.str());
-        
-        // Se o nó for o gateway (ID 10), envia uma resposta (ACK) ao remetente.
-        if (m_nodeId == 10) {
-            // Extrai o endereço IPv6 e a porta do remetente.
-            Ipv6Address sourceAddr = Inet6SocketAddress::ConvertFrom(from).GetIpv6();
-            uint16_t sourcePort = Inet6SocketAddress::ConvertFrom(from).GetPort();
-            SendResponse(socket, sourceAddr, sourcePort);  // Envia o ACK.
-        }
-    }
-}
-
-// Função para o gateway enviar uma resposta (ACK) ao nó sensor.
-void MqttPublisher::SendResponse(Ptr<Socket> socket, Ipv6Address sourceAddr, uint16_t sourcePort) {
-    char response[] = "ACK";  // Mensagem de resposta simples.
-    // Cria um pacote com a mensagem "ACK".
-    Ptr<Packet> packet = Create<Packet>((uint8_t*)response, strlen(response));
-    // Envia o pacote de volta ao remetente.
-    socket->SendTo(packet, 0, Inet6SocketAddress(sourceAddr, sourcePort));
-    // Registra o evento no CSV.
-    std::stringstream details;  // Cria um stringstream para formatar os detalhes.
-    details << "To: " << sourceAddr;  // Detalhe: endereço de destino do ACK.
-    WriteToLogCsv(Simulator::Now().GetSeconds(), m_nodeId, "Gateway Response", details.str());
-}
-
-// Função chamada para iniciar a aplicação (enviar pacotes).
-void MqttPublisher::StartApplication(void) {
-    // Verifica se o limite de pacotes foi atingido.
-    if (m_packetCount >= MAX_PACKETS) {
-        // Se atingiu o limite, registra o evento no CSV e retorna.
-        WriteToLogCsv(Simulator::Now().GetSeconds(), m_nodeId, "Reached Max Packets", "Max Packets: " + std::to_string(MAX_PACKETS));
-        return;
+bool PcapCapture::Attach(const std::string& prefix, const NetDeviceContainer& devices, const std::set<uint32_t>& nodes,
+                         bool allNodes) {
+    for (uint32_t i = 0; i < devices.GetN(); ++i) {
+        Ptr<lrwpan::LrWpanNetDevice> device = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
+        uint32_t nodeId = device->GetNode()->GetId();
+        if (!allNodes && nodes.count(nodeId) == 0) {
+            continue;
+        }
+        auto file = std::make_unique<File>();
+        file->path = prefix + "-" + std::to_string(nodeId) + "-" + std::to_string(device->GetIfIndex()) + ".pcap";
+        if (m_config.compress) {
+            file->path += ".gz";
+            // Um gzip que termina antes da hora vira erro de escrita (EPIPE), e não SIGPIPE na simulação.
+            std::signal(SIGPIPE, SIG_IGN);
+            file->file = OpenGzip(file->path, file->gzip);
+        } else {
+            file->file = std::fopen(file->path.c_str(), "wb");
+        }
+        if (!file->file) {
+            NS_LOG_ERROR("Failed to open " << file->path << " for writing");
+            return false;
+        }
+        // Cabeçalho global do formato libpcap (microssegundos), com o tipo de enlace do LrWpanHelper.
+        struct {
+            uint32_t magic = 0xa1b2c3d4;
+            uint16_t versionMajor = 2;
+            uint16_t versionMinor = 4;
+            int32_t thisZone = 0;
+            uint32_t sigFigs = 0;
+            uint32_t snaplen;
+            uint32_t network = PcapHelper::DLT_IEEE802_15_4;
+        } header;
+        header.snaplen = m_config.snaplen ? m_config.snaplen : 65535;
+        file->buffer.reserve(m_config.bufferBytes);
+        file->buffer.insert(file->buffer.end(), reinterpret_cast<const uint8_t*>(&header),
+                            reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+        m_bytesWritten += sizeof(header);
+        device->GetMac()->TraceConnectWithoutContext("Sniffer", MakeBoundCallback(&PcapCapture::Sniff, this, file.get()));
+        m_files.push_back(std::move(file));
     }
+    return true;
+}
 
-    m_running = true;  // Marca a aplicação como ativa.
-    // Se o socket ainda não foi criado, cria e configura.
-    if (!m_socket) {
-        // Cria um socket UDP para o nó.
-        m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
-        // Configuração específica para o gateway (nó 10).
-        if (m_nodeId == 10) {
-            // Vincula o socket à porta 1883 para escutar pacotes (endereço "any").
-            if (m_socket->Bind(Inet6SocketAddress(Ipv6Address::GetAny(), m_port)) == -1) {
-                NS_LOG_ERROR("Gateway (Node " << m_nodeId << ") failed to bind socket to port " << m_port);
-                return;
-            }
+void PcapCapture::Sniff(PcapCapture* capture, File* file, Ptr<const Packet> packet) {
+    auto t0 = std::chrono::steady_clock::now();
+    const Config& config = capture->m_config;
+    capture->m_framesSeen++;
+    Time now = Simulator::Now();
+    if (now >= config.start && (config.stop.IsZero() || now <= config.stop) && file->seen++ % config.sample == 0) {
+        uint32_t origLen = packet->GetSize();
+        uint32_t length = config.snaplen ? std::min(origLen, config.snaplen) : origLen;
+        capture->m_frame.resize(length);
+        packet->CopyData(capture->m_frame.data(), length);
+        int64_t nowNs = now.GetNanoSeconds();
+        if (config.latencyNs == 0 || nowNs <= capture->m_triggeredUntilNs) {
+            capture->Write(*file, nowNs, origLen, capture->m_frame.data(), length);
         } else {
-            // Para sensores, vincula o socket a uma porta local qualquer.
-            if (m_socket->Bind() == -1) {
-                NS_LOG_ERROR("Node " << m_nodeId << " failed to bind socket");
-                return;
+            file->pending.push_back(Frame{nowNs, origLen, capture->m_frame});
+            while (file->pending.front().timeNs < nowNs - config.triggerWindow.GetNanoSeconds()) {
+                file->pending.pop_front();
             }
-            // Conecta o socket ao endereço e porta do gateway.
-            m_socket->Connect(Inet6SocketAddress(m_peerAddress, m_port));
         }
-        // Configura a função de callback para receber pacotes.
-        m_socket->SetRecvCallback(MakeCallback(&MqttPublisher::HandleReceive, this));
     }
+    capture->m_wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
 
-    // Apenas os sensores (nós 0-9) enviam pacotes.
-    if (m_nodeId != 10) {
-        // Cria uma mensagem simulada de temperatura e umidade.
-        char message[32];
-        double temp = 20.0 + (rand() % 100) / 10.0;  // Temperatura entre 20 e 30°C.
-        int hum = 50 + rand() % 30;  // Umidade entre 50 e 80%.
-        snprintf(message, sizeof(message), "Temp: %.1f C, Hum: %d%%", temp, hum);
-        uint32_t messageLength = strlen(message);
+void PcapCapture::Latency(int64_t latencyNs) {
+    if (m_config.latencyNs == 0 || latencyNs <= m_config.latencyNs) {
+        return;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    m_triggers++;
+    int64_t nowNs = Simulator::Now().GetNanoSeconds();
+    m_triggeredUntilNs = nowNs + m_config.triggerWindow.GetNanoSeconds();
+    for (auto& file : m_files) {
+        for (const Frame& frame : file->pending) {
+            if (frame.timeNs >= nowNs - m_config.triggerWindow.GetNanoSeconds()) {
+                Write(*file, frame.timeNs, frame.origLen, frame.data.data(), frame.data.size());
+            }
+        }
+        file->pending.clear();
+    }
+    m_wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
 
-        // Aloca um buffer para a mensagem e copia o conteúdo.
-        uint8_t* buffer = new uint8_t[messageLength];
-        std::memcpy(buffer, message, messageLength);
-        // Cria um pacote com a mensagem.
-        Ptr<Packet> packet = Create<Packet>(buffer, messageLength);
-        delete[] buffer;  // Libera o buffer.
+void PcapCapture::Write(File& file, int64_t timeNs, uint32_t origLen, const uint8_t* data, uint32_t length) {
+    uint32_t record[4] = {static_cast<uint32_t>(timeNs / 1000000000), static_cast<uint32_t>(timeNs % 1000000000 / 1000),
+                          length, origLen};
+    file.buffer.insert(file.buffer.end(), reinterpret_cast<const uint8_t*>(record),
+                       reinterpret_cast<const uint8_t*>(record) + sizeof(record));
+    file.buffer.insert(file.buffer.end(), data, data + length);
+    m_framesWritten++;
+    m_bytesWritten += sizeof(record) + length;
+    if (file.buffer.size() >= m_config.bufferBytes) {
+        Flush(file);
+    }
+}
 
-        // Envia o pacote e registra o evento no CSV.
-        int result = m_socket->Send(packet);
-        std::stringstream details;  // Cria um stringstream para formatar os detalhes.
-        details << "Packet: " << m_packetCount << ", Message: " << message << ", Send Result: " << result << ", Length: " << messageLength;
-        WriteToLogCsv(Simulator::Now().GetSeconds(), m_nodeId, "Sent Packet", details.str());
-        m_packetCount++;  // Incrementa o contador de pacotes enviados.
+void PcapCapture::Flush(File& file) {
+    if (std::fwrite(file.buffer.data(), 1, file.buffer.size(), file.file) != file.buffer.size()) {
+        file.failed = true;
+    }
+    file.buffer.clear();
+}
 
-        // Se ainda não atingiu o limite de pacotes, agenda o próximo envio.
-        if (m_running && m_packetCount < MAX_PACKETS) {
-            // Intervalo variado entre 0,5 e 2,5 segundos para introduzir aleatoriedade.
-            double interval = 0.5 + (rand() % 20) / 10.0;
-            Simulator::Schedule(Seconds(interval), &MqttPublisher::StartApplication, this);
+void PcapCapture::Close() {
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto& file : m_files) {
+        if (!file->file) {
+            continue;
+        }
+        Flush(*file);
+        bool ok = std::fclose(file->file) == 0 && !file->failed;
+        file->file = nullptr;
+        if (file->gzip > 0) {
+            int status = 0;
+            ok = waitpid(file->gzip, &status, 0) == file->gzip && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+            file->gzip = -1;
         }
+        if (!ok) {
+            m_failedFiles++;
+            NS_LOG_ERROR("Capture " << file->path << " is incomplete (write error or gzip failure)");
+        }
+        std::ifstream written(file->path, std::ios::binary | std::ios::ate);
+        m_diskBytes += written ? static_cast<uint64_t>(written.tellg()) : 0;
     }
+    m_wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
 }
 
-// Função chamada para parar a aplicação.
-void MqttPublisher::StopApplication(void) {
-    m_running = false;  // Marca a aplicação como inativa.
-    // Fecha o socket, se existente.
-    if (m_socket) {
-        m_socket->Close();
-        m_socket = 0;
+// Lê um campo de memória (em kB) de /proc/self/status, ex.: "VmRSS:" ou "VmHWM:".
+// Retorna 0 se o campo não estiver disponível (sistemas que não são Linux).
+uint64_t ReadProcStatusKb(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, field.size(), field) == 0) {
+            return std::strtoull(line.c_str() + field.size(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+// Implementação do escalonador de eventos do ns-3 escolhida por --scheduler.
+bool ParseScheduler(const std::string& name, std::string& typeName) {
+    static const std::map<std::string, std::string> schedulers = {
+        {"map", "ns3::MapScheduler"},
+        {"heap", "ns3::HeapScheduler"},
+        {"calendar", "ns3::CalendarScheduler"},
+        {"list", "ns3::ListScheduler"},
+        {"priority", "ns3::PriorityQueueScheduler"},
+    };
+    auto it = schedulers.find(name);
+    if (it == schedulers.end()) {
+        return false;
+    }
+    typeName = it->second;
+    return true;
+}
+
+// Estatísticas da fila de eventos coletadas pelo ProfilingScheduler.
+struct EventQueueProfile {
+    struct TypeStats {
+        uint64_t executed = 0;
+        uint64_t wallNs = 0;  // Tempo de relógio até o próximo evento (execução do evento e o que ele agenda).
+    };
+    uint64_t scheduled = 0;  // Insert.
+    uint64_t executed = 0;  // RemoveNext (inclui os cancelados, que o simulador descarta ao retirar).
+    uint64_t cancelled = 0;  // Retirados já cancelados.
+    uint64_t removed = 0;  // Simulator::Remove.
+    uint64_t depth = 0;
+    uint64_t maxDepth = 0;
+    std::unordered_map<std::type_index, TypeStats> types;  // Por classe do EventImpl.
+
+    // Atribui o tempo desde a última chamada ao evento anterior e passa a medir o evento next.
+    void Account(std::type_index next) {
+        auto now = std::chrono::steady_clock::now();
+        if (running) {
+            TypeStats& stats = types[current];
+            stats.executed++;
+            stats.wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+        }
+        running = next != std::type_index(typeid(void));
+        current = next;
+        start = now;
+    }
+    // Fecha a medição do último evento (chamar após Simulator::Run).
+    void Flush() { Account(std::type_index(typeid(void))); }
+
+    bool running = false;
+    std::type_index current = std::type_index(typeid(void));
+    std::chrono::steady_clock::time_point start;
+};
+
+EventQueueProfile eventProfile;
+
+// Escalonador que delega a outro (atributo "Scheduler") e conta, na fila global de eventos, os
+// eventos agendados, executados e removidos, a profundidade máxima e o tempo de relógio por tipo
+// de evento. O simulador chama RemoveNext logo antes de executar cada evento, então o intervalo
+// entre duas chamadas é atribuído ao evento anterior.
+class ProfilingScheduler : public Scheduler {
+public:
+    static TypeId GetTypeId();
+    void Insert(const Event& ev) override {
+        eventProfile.scheduled++;
+        eventProfile.maxDepth = std::max(eventProfile.maxDepth, ++eventProfile.depth);
+        m_inner->Insert(ev);
+    }
+    bool IsEmpty() const override { return m_inner->IsEmpty(); }
+    Event PeekNext() const override { return m_inner->PeekNext(); }
+    Event RemoveNext() override {
+        Event ev = m_inner->RemoveNext();
+        eventProfile.depth--;
+        eventProfile.executed++;
+        if (ev.impl->IsCancelled()) {
+            eventProfile.cancelled++;
+        }
+        eventProfile.Account(std::type_index(typeid(*ev.impl)));
+        return ev;
+    }
+    void Remove(const Event& ev) override {
+        m_inner->Remove(ev);
+        eventProfile.depth--;
+        eventProfile.removed++;
+    }
+private:
+    void SetInnerType(std::string name) {
+        ObjectFactory factory;
+        factory.SetTypeId(name);
+        m_inner = factory.Create<Scheduler>();
+    }
+
+    Ptr<Scheduler> m_inner;
+};
+
+TypeId ProfilingScheduler::GetTypeId() {
+    static TypeId tid = TypeId("ProfilingScheduler")
+                            .SetParent<Scheduler>()
+                            .AddConstructor<ProfilingScheduler>()
+                            .AddAttribute("Scheduler", "TypeId name of the scheduler that holds the events",
+                                          TypeId::ATTR_SET | TypeId::ATTR_CONSTRUCT, StringValue("ns3::MapScheduler"),
+                                          MakeStringAccessor(&ProfilingScheduler::SetInnerType), MakeStringChecker());
+    return tid;
+}
+
+NS_OBJECT_ENSURE_REGISTERED(ProfilingScheduler);
+
+// Nome legível da classe de um evento (ex.: o EventMemberImpl do MakeEvent de um método).
+std::string DemangleEventType(const std::type_index& type) {
+    int status = 0;
+    char* name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    std::string result = status == 0 && name ? name : type.name();
+    std::free(name);
+    return result;
+}
+
+// Marcadores para o perf: escreve um comando ("enable"/"disable") no FIFO de controle de um
+// perf record --control=fifo:<arquivo> --delay=-1, para amostrar só a fase de medição.
+void PerfControl(const std::string& fifo, const char* command) {
+    if (fifo.empty()) {
+        return;
+    }
+    std::ofstream control(fifo);
+    control << command << std::endl;
+}
+
+// Snapshot da rede após a fase de formação (associação à PAN e, na malha, o DODAG convergido),
+// gravado com --saveSnapshot e carregado com --loadSnapshot para pular essa fase nas execuções seguintes.
+// Formato: SnapshotHeader, nodeCount registros SnapshotNodeRecord (na ordem dos nós) e routeCount
+// registros SnapshotRouteRecord com as rotas descendentes dos DAOs.
+struct SnapshotHeader {
+    char magic[8];            // "SLPSNAPS"
+    uint32_t version;         // Versão do formato.
+    uint32_t nodeRecordSize;  // sizeof(SnapshotNodeRecord).
+    uint32_t routeRecordSize; // sizeof(SnapshotRouteRecord).
+    uint32_t nSensors;        // Parâmetros da topologia que gerou o snapshot.
+    uint32_t nGateways;
+    uint32_t topology;        // 0 = disc, 1 = grid, 2 = random.
+    uint32_t rngSeed;         // Semente e execução do RNG (posições da topologia random).
+    uint32_t nodeCount;
+    uint64_t rngRun;
+    uint64_t routeCount;
+    double captureTime;       // Instante simulado da captura (s), o início da fase de medição.
+};
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader deve ter 64 bytes");
+
+struct SnapshotNodeRecord {
+    uint32_t nodeId;
+    uint16_t panId;
+    uint16_t shortAddr;
+    uint16_t coordShortAddr;  // Coordenador associado (0xFFFF se o nó não se associou).
+    uint16_t rank;            // Rank RPL (INFINITE_RANK fora do DODAG ou no modo disc).
+    uint8_t address[16];      // Endereço IPv6 global, para validar o endereçamento ao carregar.
+    uint8_t parent[16];       // Pai preferido (link-local).
+    uint8_t dodagId[16];
+};
+static_assert(sizeof(SnapshotNodeRecord) == 60, "SnapshotNodeRecord deve ter 60 bytes");
+
+struct SnapshotRouteRecord {
+    uint32_t nodeIndex;       // Posição do nó na ordem dos registros de nós.
+    uint8_t target[16];
+    uint8_t nextHop[16];
+};
+static_assert(sizeof(SnapshotRouteRecord) == 36, "SnapshotRouteRecord deve ter 36 bytes");
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+struct NetworkSnapshot {
+    SnapshotHeader header;
+    std::vector<SnapshotNodeRecord> nodes;
+    std::vector<SnapshotRouteRecord> routes;
+};
+
+bool SaveNetworkSnapshot(const std::string& path, NetworkSnapshot& snapshot) {
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+        NS_LOG_ERROR("Failed to open " << path << " for writing");
+        return false;
+    }
+    SnapshotHeader& header = snapshot.header;
+    std::memcpy(header.magic, "SLPSNAPS", sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.nodeRecordSize = sizeof(SnapshotNodeRecord);
+    header.routeRecordSize = sizeof(SnapshotRouteRecord);
+    header.nodeCount = snapshot.nodes.size();
+    header.routeCount = snapshot.routes.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+              std::fwrite(snapshot.nodes.data(), sizeof(SnapshotNodeRecord), snapshot.nodes.size(), out) == snapshot.nodes.size() &&
+              std::fwrite(snapshot.routes.data(), sizeof(SnapshotRouteRecord), snapshot.routes.size(), out) == snapshot.routes.size();
+    std::fclose(out);
+    if (!ok) {
+        NS_LOG_ERROR("Failed to write " << path);
+    }
+    return ok;
+}
+
+bool LoadNetworkSnapshot(const std::string& path, NetworkSnapshot& snapshot) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        NS_LOG_ERROR("Failed to open " << path << " for reading");
+        return false;
+    }
+    // As contagens do cabeçalho só são aceitas se couberem no arquivo (snapshot truncado ou corrompido).
+    std::fseek(in, 0, SEEK_END);
+    uint64_t payload = std::max<long>(std::ftell(in), sizeof(SnapshotHeader)) - sizeof(SnapshotHeader);
+    std::fseek(in, 0, SEEK_SET);
+    SnapshotHeader& header = snapshot.header;
+    bool ok = std::fread(&header, sizeof(header), 1, in) == 1 &&
+              std::memcmp(header.magic, "SLPSNAPS", sizeof(header.magic)) == 0 && header.version == SNAPSHOT_VERSION &&
+              header.nodeRecordSize == sizeof(SnapshotNodeRecord) && header.routeRecordSize == sizeof(SnapshotRouteRecord) &&
+              header.nodeCount <= payload / sizeof(SnapshotNodeRecord) &&
+              header.routeCount <= (payload - header.nodeCount * sizeof(SnapshotNodeRecord)) / sizeof(SnapshotRouteRecord);
+    if (ok) {
+        snapshot.nodes.resize(header.nodeCount);
+        snapshot.routes.resize(header.routeCount);
+        ok = std::fread(snapshot.nodes.data(), sizeof(SnapshotNodeRecord), header.nodeCount, in) == header.nodeCount &&
+             std::fread(snapshot.routes.data(), sizeof(SnapshotRouteRecord), header.routeCount, in) == header.routeCount;
     }
+    std::fclose(in);
+    if (!ok) {
+        NS_LOG_ERROR(path << " is not a valid network snapshot");
+    }
+    return ok;
 }
 
 // Função principal da simulação.
 int main(int argc, char *argv[]) {
-    // Inicializa o arquivo CSV para logs.
-    InitializeLogCsv();
+    // Parâmetros da topologia e do tráfego.
+    uint32_t nSensors = 10;  // Sensores por PAN.
+    uint32_t nGateways = 1;  // Número de PANs, cada uma com seu gateway.
+    uint32_t maxPackets = 10;  // Número máximo de pacotes que cada sensor pode enviar.
+    double duration = 15.0;  // Duração da simulação (s).
+    double appStart = 2.0;  // Início das aplicações dos sensores (s), após a associação.
+    double assocInterval = 0.1;  // Espaçamento entre as associações dos nós ao coordenador (s).
+    WorkloadConfig workload;  // Modelo de carga dos sensores.
+    std::string workloadModel = "uniform";  // uniform, periodic, poisson, onoff ou trace.
+    std::string traceFile;  // CSV "sensor,timestamp" usado pelo modelo trace.
+    bool verbose = true;  // Habilita os logs detalhados dos módulos no terminal.
+    std::string outputDir = "/ns-3-dev/output";  // Diretório dos arquivos de saída desta execução.
+    // Parâmetros do log de eventos.
+    std::string eventLogMode = "binary";  // "binary" (anel + thread escritor) ou "csv" (legado, flush por evento).
+    bool convertToCsv = true;  // Converte o events.bin para logs.csv ao final (para o plot_metrics.py).
+    uint32_t eventLogBlockRecords = 4096;  // Registros por bloco do anel.
+    uint32_t eventLogBlocks = 8;  // Número de blocos do anel.
+    // Parâmetros do MQTT-SN.
+    uint32_t qos = 1;  // QoS das publicações dos sensores (0, 1 ou 2).
+    double retryTimeout = 1.0;  // Espera por uma confirmação antes de retransmitir (s).
+    uint32_t maxRetries = 3;  // Retransmissões antes de desistir de uma mensagem.
+    double brokerDelay = 0.001;  // Tempo de serviço (médio) do broker por mensagem (s).
+    uint32_t brokerWorkers = 0;  // Workers de cada broker (0 = sem disputa, só o atraso).
+    uint32_t brokerQueue = 0;  // Limite da fila de entrada do broker (0 = sem limite).
+    std::string brokerOverflow = "drop";  // Fila cheia: drop ou backpressure.
+    std::string brokerService = "constant";  // Tempo de serviço: constant ou exponential.
+    double congestionWait = 2.0;  // Espera dos clientes após uma rejeição por congestionamento (s).
+    uint32_t gatewaysPerPan = 1;  // Gateways (brokers) por PAN.
+    std::string gatewayAssign = "hash";  // Distribuição dos sensores entre os gateways: hash ou leastload.
+    uint32_t nSubscribers = 0;  // Sensores por PAN que também assinam tópicos no broker.
+    std::string subscribeTopic = "sensors/#";  // Filtro assinado pelos assinantes.
+    uint32_t subscriberQos = 1;  // QoS máximo das assinaturas.
+    std::string payloadFormat = "binary";  // Formato do conteúdo das publicações: binary ou text.
+    uint64_t benchmarkPayload = 0;  // Se > 0, roda só o micro-benchmark de montagem das publicações.
+    double latencyInterval = 5.0;  // Intervalo entre snapshots dos histogramas de latência (s); 0 = só no fim.
+    bool packetTrace = false;  // Grava cada pacote enviado/entregue no packets.bin.
+    double kpiInterval = 0.0;  // Janela dos KPIs do kpi.csv (s); 0 = desligado.
+    std::string scheduler = "map";  // Fila de eventos do simulador: map, heap, calendar, list ou priority.
+    bool eventStats = false;  // Conta eventos e mede o tempo por tipo de evento (event_stats.csv).
+    std::string perfControl = "";  // FIFO de controle do perf record, habilitado só na fase de medição.
+    double stopPrecision = 0.0;  // Encerra quando os KPIs convergem nesta precisão relativa; 0 = vai até o fim.
+    uint32_t stopMinWindows = 10;  // Janelas com tráfego antes de poder encerrar.
+    // Parâmetros de energia dos sensores (correntes padrão do CC2420).
+    double initialEnergy = 27000.0;  // Energia inicial da bateria (J): 2 pilhas AA.
+    double supplyVoltage = 3.0;  // Tensão de alimentação (V).
+    double offCurrent = 0.000426;  // Corrente com o transceptor desligado (A).
+    double idleCurrent = 0.0188;  // Corrente em escuta ociosa, CCA e backoff (A).
+    double rxCurrent = 0.0188;  // Corrente recebendo um quadro (A).
+    double txCurrent = 0.0174;  // Corrente transmitindo a 0 dBm (A).
+    bool dutyCycle = false;  // Desliga o rádio dos sensores entre as transmissões.
+    double rxWindow = 0.1;  // Janela de recepção após cada transmissão com duty cycling (s).
+    // Parâmetros da topologia em malha (multi-salto).
+    std::string topology = "disc";  // disc (salto único, raio de 10 m), grid ou random (malha com RPL).
+    double areaSize = 200.0;  // Lado da área quadrada de cada PAN no modo random (m).
+    double gridSpacing = 30.0;  // Distância entre sensores vizinhos no modo grid (m).
+    double pathLossExponent = 3.0;  // Expoente da perda log-distância.
+    bool fading = false;  // Acrescenta desvanecimento Nakagami à perda log-distância.
+    double dioIntervalMin = 0.5;  // Intervalo mínimo do Trickle dos DIOs (s).
+    uint32_t dioDoublings = 6;  // Dobras do intervalo do Trickle.
+    uint32_t dioRedundancy = 3;  // Constante de redundância k do Trickle.
+    double daoInterval = 10.0;  // Intervalo de renovação dos DAOs (s).
+    // Captura PCAP dos quadros LR-WPAN (desligada por padrão).
+    std::string pcapNodes;  // Nós capturados: vazio (nenhum), "all" ou lista como "0,3,10-19".
+    PcapCapture::Config pcapConfig;
+    double pcapStart = 0.0;  // Janela de captura (s).
+    double pcapStop = 0.0;  // 0 = até o fim.
+    double pcapLatency = 0.0;  // Grava só perto de pacotes entregues com atraso acima deste (ms); 0 = sempre.
+    double pcapTriggerWindow = 1.0;  // Quadros gravados antes e depois de cada disparo (s).
+    uint32_t pcapBufferKb = 1024;  // Buffer de cada arquivo de captura.
+    // Snapshot da fase de formação da rede (associação, endereços e rotas do DODAG).
+    std::string saveSnapshot;  // Grava o estado da rede no instante appStart neste arquivo.
+    std::string loadSnapshot;  // Carrega o estado deste arquivo e pula a fase de formação.
 
-    // Habilita logs detalhados para vários componentes, mas mantém no terminal apenas para depuração.
-    LogComponentEnable("MqttPublisher", LOG_LEVEL_INFO);  // Logs da classe MqttPublisher (mantidos para depuração).
-    LogComponentEnable("Ipv6AddressHelper", LOG_LEVEL_INFO);  // Logs para configuração de endereços IPv6.
-    LogComponentEnable("SixLowPanNetDevice", LOG_LEVEL_INFO);  // Logs para dispositivos 6LoWPAN.
-    LogComponentEnable("LrWpanNetDevice", LOG_LEVEL_INFO);  // Logs para dispositivos LrWpan.
-    LogComponentEnable("LrWpanMac", LOG_LEVEL_INFO);  // Logs para a camada MAC LrWpan (reduzido para evitar excesso).
-
-    // Cria 11 nós: 10 sensores (0-9) e 1 gateway (10).
-    NodeContainer nodes;
-    nodes.Create(11);
-
-    // Configura a camada LrWpan (IEEE 802.15.4).
-    LrWpanHelper lrWpanHelper;
-    // Instala dispositivos LrWpan nos nós.
-    NetDeviceContainer devices = lrWpanHelper.Install(nodes);
-
-    // Configura endereços MAC únicos e PAN ID.
-    uint16_t panId = 0x1234;  // ID do PAN (Personal Area Network).
-    Mac16Address coordShortAddr("00:00");  // Endereço curto do coordenador (nó 0).
-    // Loop para configurar cada dispositivo LrWpan.
-    for (uint32_t i = 0; i < devices.GetN(); ++i) {
-        Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
-        // Define um endereço curto único para cada dispositivo.
-        uint8_t macAddr[2] = {0x00, static_cast<uint8_t>(i)};
-        Mac16Address shortAddr;
-        shortAddr.CopyFrom(macAddr);
-        lrWpanDev->SetAddress(shortAddr);
-        lrWpanDev->GetMac()->SetPanId(panId);  // Associa ao PAN.
-        // Define um endereço estendido único.
-        std::ostringstream oss;
-        oss << "00:00:00:00:00:00:00:" << std::setfill('0') << std::setw(2) << std::hex << i;
-        lrWpanDev->GetMac()->SetExtendedAddress(Mac64Address(oss.str().c_str()));
-        // Loga os endereços configurados.
-        NS_LOG_INFO("LrWpan Device " << i << " Short MAC: " << lrWpanDev->GetAddress() << ", Extended MAC: " << lrWpanDev->GetMac()->GetExtendedAddress() << ", PAN ID: " << lrWpanDev->GetMac()->GetPanId());
-    }
-
-    // Configura o nó 0 como coordenador do PAN.
-    Ptr<lrwpan::LrWpanNetDevice> coordDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(0));
-    Ptr<lrwpan::LrWpanMac> coordMac = coordDev->GetMac();
-    coordMac->SetShortAddress(coordShortAddr);
-    lrwpan::MlmeStartRequestParams startParams;  // Parâmetros para iniciar o PAN.
-    startParams.m_PanId = panId;
-    startParams.m_bcnOrd = 15;  // Modo sem beacon (non-beacon enabled).
-    startParams.m_sfrmOrd = 15;  // Modo sem superframe.
-    coordMac->MlmeStartRequest(startParams);
-    NS_LOG_INFO("Started PAN on coordinator with Short MAC: " << coordShortAddr << ", PAN ID: " << panId);
-
-    // Agenda a associação dos nós 1-10 ao PAN coordinator.
-    for (uint32_t i = 1; i < devices.GetN(); ++i) {
-        Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
-        Ptr<lrwpan::LrWpanMac> mac = lrWpanDev->GetMac();
-        lrwpan::MlmeAssociateRequestParams assocParams;  // Parâmetros para a associação.
-        assocParams.m_coordAddrMode = 2;  // Usa endereço curto para o coordenador.
-        assocParams.m_coordShortAddr = coordShortAddr;  // Endereço do coordenador.
-        assocParams.m_coordPanId = panId;  // PAN ID.
-        assocParams.m_chNum = 11;  // Canal padrão (2,4 GHz).
-        assocParams.m_chPage = 0;  // Página de canal padrão.
-        assocParams.m_capabilityInfo = 0x80;  // Dispositivo FFD, capaz de ser coordenador.
-        // Agenda a associação em tempos escalonados (0,1s * i) para evitar colisões.
-        Simulator::Schedule(Seconds(0.1 * i), &lrwpan::LrWpanMac::MlmeAssociateRequest, mac, assocParams);
-        NS_LOG_INFO("Scheduled association for MAC: " << mac->GetShortAddress() << " to PAN ID: " << panId << " with coordinator: " << coordShortAddr << " at time " << Seconds(0.1 * i));
-    }
-
-    // Habilita captura de pacotes (PCAP) para depuração.
-    lrWpanHelper.EnablePcap("lrwpan", devices);
-
-    // Configura a mobilidade dos nós.
-    MobilityHelper mobility;
-    // Usa um alocador de posições em disco (centro em X=50, Y=50, raio variável até 10).
-    mobility.SetPositionAllocator("ns3::RandomDiscPositionAllocator",
-                                 "X", StringValue("50.0"),
-                                 "Y", StringValue("50.0"),
-                                 "Rho", StringValue("ns3::UniformRandomVariable[Min=0|Max=10]"));
-    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");  // Nós fixos.
-    mobility.Install(nodes);
-
-    // Instala a pilha de protocolos de internet (IPv6, UDP, etc.).
-    InternetStackHelper internet;
-    internet.Install(nodes);
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("nSensors", "Number of sensor nodes per PAN", nSensors);
+    cmd.AddValue("nGateways", "Number of PANs, each with its own gateway and LR-WPAN channel", nGateways);
+    cmd.AddValue("maxPackets", "Maximum number of packets published by each sensor", maxPackets);
+    cmd.AddValue("duration", "Simulation duration in seconds", duration);
+    cmd.AddValue("appStart", "Start time of the sensor applications in seconds", appStart);
+    cmd.AddValue("assocInterval", "Spacing between PAN association requests in seconds", assocInterval);
+    cmd.AddValue("workload", "Publish workload model: uniform, periodic, poisson, onoff or trace", workloadModel);
+    cmd.AddValue("minInterval", "uniform: minimum interval between publications in seconds", workload.minInterval);
+    cmd.AddValue("maxInterval", "uniform: maximum interval between publications in seconds", workload.maxInterval);
+    cmd.AddValue("period", "periodic: interval between publications in seconds", workload.period);
+    cmd.AddValue("meanInterval", "poisson: mean interval between publications in seconds", workload.meanInterval);
+    cmd.AddValue("onMean", "onoff: mean duration of an ON burst in seconds", workload.onMean);
+    cmd.AddValue("offMean", "onoff: mean duration of an OFF period in seconds", workload.offMean);
+    cmd.AddValue("burstInterval", "onoff: interval between publications during a burst in seconds", workload.burstInterval);
+    cmd.AddValue("traceFile", "trace: CSV of sensor,timestamp rows replayed by the sensors", traceFile);
+    cmd.AddValue("verbose", "Enable INFO logging for the LR-WPAN, 6LoWPAN and MqttPublisher components", verbose);
+    cmd.AddValue("outputDir", "Directory where the event log, metrics and pcaps of this run are written", outputDir);
+    cmd.AddValue("eventLog", "Event log mode: binary (buffered, background writer) or csv (legacy, flushed per event)", eventLogMode);
+    cmd.AddValue("convertLog", "Convert the binary event log to logs.csv after the run", convertToCsv);
+    cmd.AddValue("eventLogBlockRecords", "Records per ring buffer block of the binary event log", eventLogBlockRecords);
+    cmd.AddValue("eventLogBlocks", "Number of blocks in the binary event log ring buffer", eventLogBlocks);
+    cmd.AddValue("qos", "MQTT-SN QoS level of the sensor publications (0, 1 or 2)", qos);
+    cmd.AddValue("retryTimeout", "MQTT-SN retransmission timeout in seconds", retryTimeout);
+    cmd.AddValue("maxRetries", "MQTT-SN retransmissions before a message is dropped", maxRetries);
+    cmd.AddValue("brokerDelay", "Broker service time (mean) per MQTT-SN message in seconds", brokerDelay);
+    cmd.AddValue("brokerWorkers", "Worker threads of each broker (0 = every message only delayed, no contention)", brokerWorkers);
+    cmd.AddValue("brokerQueue", "Ingress queue limit of each broker in messages (0 = unbounded)", brokerQueue);
+    cmd.AddValue("brokerOverflow", "Broker action on a full ingress queue: drop or backpressure (reject with congestion)", brokerOverflow);
+    cmd.AddValue("brokerService", "Broker service time distribution: constant or exponential", brokerService);
+    cmd.AddValue("congestionWait", "Client wait before resending a message rejected for congestion, in seconds", congestionWait);
+    cmd.AddValue("gatewaysPerPan", "Gateways (brokers) per PAN", gatewaysPerPan);
+    cmd.AddValue("gatewayAssign", "Assignment of the sensors to the gateways of their PAN: hash or leastload", gatewayAssign);
+    cmd.AddValue("nSubscribers", "Sensor nodes per PAN that also subscribe at the broker", nSubscribers);
+    cmd.AddValue("subscribeTopic", "Topic filter of the subscribers (+ and # wildcards)", subscribeTopic);
+    cmd.AddValue("subscriberQos", "Maximum QoS level of the subscriptions", subscriberQos);
+    cmd.AddValue("payload", "Sensor payload format: binary (8-byte reading) or text (legacy)", payloadFormat);
+    cmd.AddValue("benchmarkPayload", "Run only the publish encoding micro-benchmark with this many iterations", benchmarkPayload);
+    cmd.AddValue("latencyInterval", "Interval between latency percentile/histogram snapshots in seconds (0 = end only)", latencyInterval);
+    cmd.AddValue("scheduler", "Event queue of the simulator: map, heap, calendar, list or priority", scheduler);
+    cmd.AddValue("eventStats", "Count scheduled/executed events, the queue depth and the wall time per event type (event_stats.csv)", eventStats);
+    cmd.AddValue("perfControl", "Control FIFO of perf record --control=fifo:<file> --delay=-1, enabled from appStart to the end of the run", perfControl);
+    cmd.AddValue("kpiInterval", "Interval between windowed throughput/delivery/delay snapshots in kpi.csv in seconds (0 = off)", kpiInterval);
+    cmd.AddValue("stopPrecision", "Stop once the 95% CI of the windowed KPIs is within this fraction of their mean (0 = run to the end)", stopPrecision);
+    cmd.AddValue("stopMinWindows", "Windows with traffic needed before stopPrecision can stop the run", stopMinWindows);
+    cmd.AddValue("packetTrace", "Write every UDP/TCP packet sent and delivered to packets.bin (summarized by sweep/packet_summary.py)", packetTrace);
+    cmd.AddValue("pcapNodes", "LR-WPAN pcap capture: empty (off), all, or node IDs and ranges such as 0,3,10-19", pcapNodes);
+    cmd.AddValue("pcapSample", "Write one in this many frames of each captured device", pcapConfig.sample);
+    cmd.AddValue("pcapSnaplen", "Bytes written per captured frame (0 = whole frame)", pcapConfig.snaplen);
+    cmd.AddValue("pcapStart", "Start of the capture window in seconds", pcapStart);
+    cmd.AddValue("pcapStop", "End of the capture window in seconds (0 = end of the run)", pcapStop);
+    cmd.AddValue("pcapLatency", "Only write the frames around deliveries with an end-to-end delay above this, in ms (0 = always)", pcapLatency);
+    cmd.AddValue("pcapTriggerWindow", "pcapLatency: seconds of frames written before and after each trigger", pcapTriggerWindow);
+    cmd.AddValue("pcapBufferKb", "Write buffer of each capture file in KiB", pcapBufferKb);
+    cmd.AddValue("pcapCompress", "Write the captures as .pcap.gz through gzip", pcapConfig.compress);
+    cmd.AddValue("initialEnergy", "Initial battery energy of each sensor in joules", initialEnergy);
+    cmd.AddValue("supplyVoltage", "Battery supply voltage in volts", supplyVoltage);
+    cmd.AddValue("offCurrent", "Radio current draw with the transceiver off in amperes", offCurrent);
+    cmd.AddValue("idleCurrent", "Radio current draw while idle listening (CCA, backoff) in amperes", idleCurrent);
+    cmd.AddValue("rxCurrent", "Radio current draw while receiving a frame in amperes", rxCurrent);
+    cmd.AddValue("txCurrent", "Radio current draw while transmitting in amperes", txCurrent);
+    cmd.AddValue("dutyCycle", "Turn the sensor radios off between transmissions", dutyCycle);
+    cmd.AddValue("rxWindow", "Receive window kept open after each transmission when duty cycling, in seconds", rxWindow);
+    cmd.AddValue("topology", "Node placement: disc (single hop), grid or random (multi-hop mesh with RPL-like routing)", topology);
+    cmd.AddValue("areaSize", "random: side of the square area of each PAN in meters", areaSize);
+    cmd.AddValue("gridSpacing", "grid: distance between neighbouring sensors in meters", gridSpacing);
+    cmd.AddValue("pathLossExponent", "Exponent of the log-distance path loss on the LR-WPAN channel", pathLossExponent);
+    cmd.AddValue("fading", "Add Nakagami fading on top of the log-distance path loss", fading);
+    cmd.AddValue("dioIntervalMin", "Minimum Trickle interval of the DIO messages in seconds", dioIntervalMin);
+    cmd.AddValue("dioDoublings", "Number of doublings of the DIO Trickle interval", dioDoublings);
+    cmd.AddValue("dioRedundancy", "Trickle redundancy constant of the DIO messages", dioRedundancy);
+    cmd.AddValue("daoInterval", "Refresh interval of the DAO messages in seconds", daoInterval);
+    cmd.AddValue("saveSnapshot", "Write the association, address and routing state at appStart to this file", saveSnapshot);
+    cmd.AddValue("loadSnapshot", "Start from the network state in this file instead of running the association/DODAG formation", loadSnapshot);
+    cmd.Parse(argc, argv);
 
-    // Configura a camada 6LoWPAN sobre LrWpan.
-    SixLowPanHelper sixlowpan;
-    NetDeviceContainer sixlowpanDevices = sixlowpan.Install(devices);
+    if (benchmarkPayload > 0) {
+        RunPayloadBenchmark(benchmarkPayload);
+        return 0;
+    }
 
-    // Loga informações dos dispositivos 6LoWPAN para depuração.
-    for (uint32_t i = 0; i < sixlowpanDevices.GetN(); ++i) {
-        Ptr<SixLowPanNetDevice> dev = DynamicCast<SixLowPanNetDevice>(sixlowpanDevices.Get(i));
-        NS_LOG_INFO("6LoWPAN Device " << i << ": " << dev->GetAddress() << ", Link: " << (dev->IsLinkUp() ? "Up" : "Down"));
+    // Os endereços curtos 0xFFFE e 0xFFFF são reservados pelo IEEE 802.15.4.
+    NS_ABORT_MSG_IF(gatewaysPerPan == 0, "gatewaysPerPan must be at least 1");
+    NS_ABORT_MSG_IF(nSensors + gatewaysPerPan >= 0xFFFE, "nSensors + gatewaysPerPan must be below 65534 (16-bit short addresses per PAN)");
+    NS_ABORT_MSG_IF(nGateways == 0 || nGateways > 0xFFFF, "nGateways must be between 1 and 65535");
+    NS_ABORT_MSG_IF(qos > 2 || subscriberQos > 2, "MQTT-SN QoS must be 0, 1 or 2");
+    NS_ABORT_MSG_IF(nSubscribers > nSensors, "nSubscribers must not exceed nSensors");
+    NS_ABORT_MSG_IF(kpiInterval < 0 || stopPrecision < 0, "kpiInterval and stopPrecision cannot be negative");
+    NS_ABORT_MSG_IF(stopPrecision > 0 && kpiInterval <= 0, "stopPrecision needs kpiInterval");
+    std::set<uint32_t> pcapNodeSet;
+    bool pcapAllNodes = false;
+    NS_ABORT_MSG_UNLESS(ParseNodeSet(pcapNodes, pcapNodeSet, pcapAllNodes), "Invalid pcapNodes " << pcapNodes);
+    NS_ABORT_MSG_IF(pcapConfig.sample == 0 || pcapBufferKb == 0, "pcapSample and pcapBufferKb must be at least 1");
+    NS_ABORT_MSG_IF(pcapStart < 0 || (pcapStop > 0 && pcapStop <= pcapStart), "pcapStop must be after pcapStart");
+    NS_ABORT_MSG_IF(pcapLatency < 0 || (pcapLatency > 0 && pcapTriggerWindow <= 0),
+                    "pcapLatency cannot be negative and needs a positive pcapTriggerWindow");
+    pcapConfig.start = Seconds(pcapStart);
+    pcapConfig.stop = Seconds(pcapStop);
+    pcapConfig.latencyNs = static_cast<int64_t>(pcapLatency * 1e6);
+    pcapConfig.triggerWindow = Seconds(pcapTriggerWindow);
+    pcapConfig.bufferBytes = pcapBufferKb * 1024;
+    PcapCapture pcap;
+    pcap.Configure(pcapConfig);
+    NS_ABORT_MSG_UNLESS(topology == "disc" || topology == "grid" || topology == "random", "Unknown topology " << topology);
+    bool mesh = (topology != "disc");
+    uint32_t topologyCode = topology == "disc" ? 0 : (topology == "grid" ? 1 : 2);
+    if (mesh) {
+        // Na malha os nós encaminham pela mesma interface por onde recebem; sem redirects ICMPv6.
+        Config::SetDefault("ns3::Ipv6L3Protocol::SendIcmpv6Redirect", BooleanValue(false));
     }
 
-    // Configura endereços IPv6 para os dispositivos.
-    Ipv6AddressHelper ipv6;
-    ipv6.SetBase(Ipv6Address("2001:db8::"), Ipv6Prefix(64));  // Prefixo de rede.
-    Ipv6InterfaceContainer interfaces = ipv6.Assign(sixlowpanDevices);
-    interfaces.SetForwarding(10, true);  // Habilita encaminhamento no gateway.
-    interfaces.SetDefaultRouteInAllNodes(10);  // Define o gateway como rota padrão.
+    PayloadFormat payload;
+    NS_ABORT_MSG_UNLESS(ParsePayloadFormat(payloadFormat, payload), "Unknown payload format " << payloadFormat);
+    OverflowPolicy overflow;
+    NS_ABORT_MSG_UNLESS(ParseOverflowPolicy(brokerOverflow, overflow), "Unknown broker overflow policy " << brokerOverflow);
+    GatewayAssignment assignment;
+    NS_ABORT_MSG_UNLESS(ParseGatewayAssignment(gatewayAssign, assignment), "Unknown gateway assignment " << gatewayAssign);
+    NS_ABORT_MSG_UNLESS(brokerService == "constant" || brokerService == "exponential", "Unknown broker service " << brokerService);
+    NS_ABORT_MSG_UNLESS(ParseWorkloadModel(workloadModel, workload.model), "Unknown workload model " << workloadModel);
+    std::string schedulerType;
+    NS_ABORT_MSG_UNLESS(ParseScheduler(scheduler, schedulerType), "Unknown scheduler " << scheduler);
+    // Fila de eventos, antes de qualquer evento agendado; com --eventStats, envolvida pelo ProfilingScheduler.
+    ObjectFactory schedulerFactory;
+    if (eventStats) {
+        schedulerFactory.SetTypeId("ProfilingScheduler");
+        schedulerFactory.Set("Scheduler", StringValue(schedulerType));
+    } else {
+        schedulerFactory.SetTypeId(schedulerType);
+    }
+    Simulator::SetScheduler(schedulerFactory);
+    // No modelo trace, o sensor i reproduz a série (i mod número de séries) do arquivo.
+    std::vector<WorkloadTrace> traces;
+    if (workload.model == WorkloadModel::TRACE) {
+        traces = LoadWorkloadTrace(traceFile);
+        NS_ABORT_MSG_IF(traces.empty(), "Workload trace " << traceFile << " has no samples");
+    }
+
+    // Inicializa o log de eventos.
+    bool binaryLog = (eventLogMode != "csv");
+    eventLog.Open(outputDir + (binaryLog ? "/events.bin" : "/logs.csv"),
+                  binaryLog, eventLogBlockRecords, eventLogBlocks);
 
-    // Loga os endereços IPv6 atribuídos.
-    for (uint32_t i = 0; i < interfaces.GetN(); ++i) {
-        NS_LOG_INFO("Node " << i << " Address: " << interfaces.GetAddress(i, 1));
+    // Habilita logs detalhados para vários componentes, mas mantém no terminal apenas para depuração.
+    if (verbose) {
+        LogComponentEnable("MqttPublisher", LOG_LEVEL_INFO);  // Logs da classe MqttPublisher (mantidos para depuração).
+        LogComponentEnable("Ipv6AddressHelper", LOG_LEVEL_INFO);  // Logs para configuração de endereços IPv6.
+        LogComponentEnable("SixLowPanNetDevice", LOG_LEVEL_INFO);  // Logs para dispositivos 6LoWPAN.
+        LogComponentEnable("LrWpanNetDevice", LOG_LEVEL_INFO);  // Logs para dispositivos LrWpan.
+        LogComponentEnable("LrWpanMac", LOG_LEVEL_INFO);  // Logs para a camada MAC LrWpan (reduzido para evitar excesso).
+    }
+
+    // Com um snapshot, a topologia precisa ser a mesma que o gerou; na random, também as posições sorteadas.
+    NetworkSnapshot snapshot;
+    bool warmStart = !loadSnapshot.empty();
+    if (warmStart) {
+        NS_ABORT_MSG_UNLESS(LoadNetworkSnapshot(loadSnapshot, snapshot), "Cannot load network snapshot " << loadSnapshot);
+        const SnapshotHeader& header = snapshot.header;
+        NS_ABORT_MSG_IF(header.nSensors != nSensors || header.nGateways != nGateways || header.topology != topologyCode,
+                        "Snapshot " << loadSnapshot << " was built for nSensors=" << header.nSensors << ", nGateways="
+                        << header.nGateways << ", topology code " << header.topology);
+        NS_ABORT_MSG_IF(topology == "random" && (header.rngSeed != RngSeedManager::GetSeed() || header.rngRun != RngSeedManager::GetRun()),
+                        "Snapshot " << loadSnapshot << " was built with RngSeed=" << header.rngSeed << ", RngRun=" << header.rngRun);
+        if (std::abs(header.captureTime - appStart) > 1e-9) {
+            NS_LOG_WARN("Snapshot was captured at " << header.captureTime << "s, appStart is " << appStart << "s");
+        }
     }
 
-    // Configura a aplicação MQTT.
+    // Memória residente antes de construir a topologia, para estimar o custo por nó.
+    uint64_t rssStartKb = ReadProcStatusKb("VmRSS:");
+    auto buildStart = std::chrono::steady_clock::now();
+
+    NodeContainer nodes;  // Todos os nós, PAN por PAN (sensores seguidos do gateway).
+    std::vector<Ptr<MqttPublisher>> sensorApps;  // Aplicações dos sensores, na ordem dos IDs.
+    std::vector<Ptr<MqttSubscriber>> subscriberApps;  // Assinantes de todas as PANs.
+    std::vector<Ptr<MqttBroker>> brokerApps;  // Brokers, um por gateway, PAN por PAN.
+    std::vector<uint32_t> sensorBroker;  // Índice em brokerApps do broker de cada sensor de sensorApps.
+    std::vector<uint32_t> brokerSensors;  // Sensores atribuídos a cada broker.
+    std::vector<double> brokerLoad;  // Taxa esperada (mensagens/s) atribuída a cada broker.
+    std::vector<Ptr<RplRouter>> routers;  // Roteadores RPL de todos os nós (modo malha), na ordem de nodes.
+    std::vector<Ptr<lrwpan::LrWpanNetDevice>> macDevices;  // Dispositivos LrWpan, na ordem de nodes.
+    std::vector<Ipv6Address> globalAddresses;  // Endereços IPv6 globais, na ordem de nodes.
+    const uint16_t rplPort = 6550;  // Porta UDP das mensagens de controle do RPL.
+    AirtimeCounter airtime;  // Quadros e bytes transmitidos pelos rádios.
+    std::vector<Ptr<LrWpanRadioEnergyModel>> energyModels;  // Modelos de energia, na ordem de sensorApps.
+    BasicEnergySourceHelper energySource;  // Bateria de cada sensor.
+    energySource.Set("BasicEnergySourceInitialEnergyJ", DoubleValue(initialEnergy));
+    energySource.Set("BasicEnergySupplyVoltageV", DoubleValue(supplyVoltage));
     uint16_t port = 1883;  // Porta padrão MQTT.
-    Ipv6Address gatewayAddress = interfaces.GetAddress(10, 1);  // Endereço do gateway.
-    NS_LOG_INFO("Gateway Address: " << gatewayAddress);
-    // Configura os nós sensores (0-9) para enviar pacotes ao gateway.
-    for (uint32_t i = 0; i < 10; ++i) {
-        Ptr<MqttPublisher> app = CreateObject<MqttPublisher>();
-        app->Setup(gatewayAddress, port, i);
-        app->SetStartTime(Seconds(2.0));  // Inicia após 2s para permitir associação.
-        app->SetStopTime(Seconds(15.0));  // Para após 15s.
-        nodes.Get(i)->AddApplication(app);
-    }
-
-    // Configura o gateway (nó 10) para receber pacotes.
-    Ptr<MqttPublisher> gatewayApp = CreateObject<MqttPublisher>();
-    gatewayApp->Setup(Ipv6Address::GetAny(), port, 10);  // Escuta em qualquer endereço.
-    gatewayApp->SetStartTime(Seconds(0.0));  // Inicia imediatamente.
-    gatewayApp->SetStopTime(Seconds(15.0));  // Para após 15s.
-    nodes.Get(10)->AddApplication(gatewayApp);
+    uint32_t panSize = nSensors + gatewaysPerPan;  // Nós por PAN: sensores (0..nSensors-1) e os gateways.
+    uint32_t gatewayIndex = nSensors;  // Índice do primeiro gateway dentro da PAN (raiz do DODAG na malha).
+
+    InternetStackHelper internet;
+    SixLowPanHelper sixlowpan;
+    Ipv6AddressHelper ipv6;
+    // Streams fixos para as variáveis aleatórias (MAC, mobilidade e aplicações): com o mesmo RngRun,
+    // a execução é reproduzível bit a bit; RngRun distintos dão execuções independentes.
+    int64_t stream = 1;
+
+    // Cada PAN recebe seu próprio canal LrWpan, PAN ID e prefixo IPv6.
+    for (uint32_t p = 0; p < nGateways; ++p) {
+        NodeContainer panNodes;
+        panNodes.Create(panSize);
+        nodes.Add(panNodes);
+
+        // Configura a camada LrWpan (IEEE 802.15.4), com um canal independente por PAN.
+        LrWpanHelper lrWpanHelper;
+        // Perda log-distância calibrada para 2,4 GHz (40 dB a 1 m) e, opcionalmente, desvanecimento Nakagami.
+        Ptr<SingleModelSpectrumChannel> channel = CreateObject<SingleModelSpectrumChannel>();
+        Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel>();
+        loss->SetPathLossExponent(pathLossExponent);
+        loss->SetReference(1.0, 40.05);
+        if (fading) {
+            loss->SetNext(CreateObject<NakagamiPropagationLossModel>());
+            stream += loss->AssignStreams(stream);
+        }
+        channel->AddPropagationLossModel(loss);
+        channel->SetPropagationDelayModel(CreateObject<ConstantSpeedPropagationDelayModel>());
+        lrWpanHelper.SetChannel(channel);
+        // Instala dispositivos LrWpan nos nós.
+        NetDeviceContainer devices = lrWpanHelper.Install(panNodes);
+
+        // Configura endereços MAC únicos e PAN ID.
+        uint16_t panId = static_cast<uint16_t>(0x1234 + p);  // ID do PAN (Personal Area Network).
+        Mac16Address coordShortAddr("00:00");  // Endereço curto do coordenador (primeiro nó da PAN).
+        // Loop para configurar cada dispositivo LrWpan.
+        for (uint32_t i = 0; i < devices.GetN(); ++i) {
+            Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
+            // Define um endereço curto único dentro da PAN.
+            uint8_t macAddr[2] = {static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i & 0xff)};
+            Mac16Address shortAddr;
+            shortAddr.CopyFrom(macAddr);
+            lrWpanDev->SetAddress(shortAddr);
+            lrWpanDev->GetMac()->SetPanId(panId);  // Associa ao PAN.
+            // Define um endereço estendido único em toda a simulação, derivado do ID global do nó.
+            uint64_t globalId = panNodes.Get(i)->GetId();
+            uint8_t extAddr[8];
+            for (uint32_t b = 0; b < 8; ++b) {
+                extAddr[b] = static_cast<uint8_t>(globalId >> (8 * (7 - b)));
+            }
+            Mac64Address extendedAddr;
+            extendedAddr.CopyFrom(extAddr);
+            lrWpanDev->GetMac()->SetExtendedAddress(extendedAddr);
+            // Loga os endereços configurados.
+            NS_LOG_INFO("LrWpan Device " << globalId << " Short MAC: " << lrWpanDev->GetAddress() << ", Extended MAC: " << lrWpanDev->GetMac()->GetExtendedAddress() << ", PAN ID: " << lrWpanDev->GetMac()->GetPanId());
+        }
+
+        // Configura o primeiro nó da PAN como coordenador.
+        Ptr<lrwpan::LrWpanNetDevice> coordDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(0));
+        Ptr<lrwpan::LrWpanMac> coordMac = coordDev->GetMac();
+        coordMac->SetShortAddress(coordShortAddr);
+        lrwpan::MlmeStartRequestParams startParams;  // Parâmetros para iniciar o PAN.
+        startParams.m_PanId = panId;
+        startParams.m_bcnOrd = 15;  // Modo sem beacon (non-beacon enabled).
+        startParams.m_sfrmOrd = 15;  // Modo sem superframe.
+        coordMac->MlmeStartRequest(startParams);
+        NS_LOG_INFO("Started PAN on coordinator with Short MAC: " << coordShortAddr << ", PAN ID: " << panId);
+
+        // Agenda a associação dos demais nós da PAN ao coordenador. Na malha o coordenador pode estar
+        // fora de alcance; como os endereços curtos e o PAN ID já foram configurados, a associação é pulada.
+        // Com um snapshot carregado, o resultado da associação é restaurado depois da construção.
+        for (uint32_t i = 1; !mesh && !warmStart && i < devices.GetN(); ++i) {
+            Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
+            Ptr<lrwpan::LrWpanMac> mac = lrWpanDev->GetMac();
+            lrwpan::MlmeAssociateRequestParams assocParams;  // Parâmetros para a associação.
+            assocParams.m_coordAddrMode = 2;  // Usa endereço curto para o coordenador.
+            assocParams.m_coordShortAddr = coordShortAddr;  // Endereço do coordenador.
+            assocParams.m_coordPanId = panId;  // PAN ID.
+            assocParams.m_chNum = 11;  // Canal padrão (2,4 GHz).
+            assocParams.m_chPage = 0;  // Página de canal padrão.
+            assocParams.m_capabilityInfo = 0x80;  // Dispositivo FFD, capaz de ser coordenador.
+            // Agenda a associação em tempos escalonados (assocInterval * i) para evitar colisões.
+            Simulator::Schedule(Seconds(assocInterval * i), &lrwpan::LrWpanMac::MlmeAssociateRequest, mac, assocParams);
+            NS_LOG_INFO("Scheduled association for MAC: " << mac->GetShortAddress() << " to PAN ID: " << panId << " with coordinator: " << coordShortAddr << " at time " << Seconds(assocInterval * i));
+        }
+        if (!mesh && !warmStart && assocInterval * (devices.GetN() - 1) > appStart) {
+            NS_LOG_WARN("PAN " << p << ": association schedule ends at " << assocInterval * (devices.GetN() - 1)
+                        << "s, after the application start time (" << appStart << "s)");
+        }
+
+        // Captura PCAP seletiva para depuração (só os nós de --pcapNodes).
+        NS_ABORT_MSG_UNLESS(pcap.Attach(outputDir + "/lrwpan", devices, pcapNodeSet, pcapAllNodes),
+                            "Cannot write the pcap files in " << outputDir);
+
+        // Conta os quadros transmitidos por todos os rádios da PAN, para estimar o tempo no ar.
+        for (uint32_t i = 0; i < devices.GetN(); ++i) {
+            Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
+            lrWpanDev->GetPhy()->TraceConnectWithoutContext("PhyTxBegin", MakeCallback(&AirtimeCounter::PhyTxBegin, &airtime));
+        }
+
+        // Configura a mobilidade dos nós.
+        MobilityHelper mobility;
+        if (!mesh) {
+            // Usa um alocador de posições em disco (raio variável até 10), com as PANs lado a lado no eixo X.
+            Ptr<RandomDiscPositionAllocator> positions = CreateObject<RandomDiscPositionAllocator>();
+            positions->SetX(50.0 + 100.0 * p);
+            positions->SetY(50.0);
+            Ptr<UniformRandomVariable> rho = CreateObject<UniformRandomVariable>();
+            rho->SetAttribute("Min", DoubleValue(0.0));
+            rho->SetAttribute("Max", DoubleValue(10.0));
+            positions->SetRho(rho);
+            stream += positions->AssignStreams(stream);
+            mobility.SetPositionAllocator(positions);
+        } else {
+            // Malha: sensores em grade ou espalhados sobre a área, com o gateway no centro.
+            Ptr<ListPositionAllocator> positions = CreateObject<ListPositionAllocator>();
+            double x0 = p * (areaSize + 100.0);  // PANs lado a lado no eixo X.
+            if (topology == "grid") {
+                uint32_t width = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(nSensors))));
+                uint32_t rows = (nSensors + width - 1) / width;
+                x0 = p * (width * gridSpacing + 100.0);
+                for (uint32_t i = 0; i < nSensors; ++i) {
+                    positions->Add(Vector(x0 + (i % width) * gridSpacing, (i / width) * gridSpacing, 0.0));
+                }
+                // Gateway no centro da grade, deslocado meia célula para não coincidir com um sensor;
+                // os demais gateways seguem a cada célula no eixo X.
+                for (uint32_t g = 0; g < gatewaysPerPan; ++g) {
+                    positions->Add(Vector(x0 + (width - 1) * gridSpacing / 2.0 + gridSpacing / 2.0 + g * gridSpacing,
+                                          (rows - 1) * gridSpacing / 2.0 + gridSpacing / 2.0, 0.0));
+                }
+            } else {
+                Ptr<UniformRandomVariable> coord = CreateObject<UniformRandomVariable>();
+                coord->SetStream(stream++);
+                for (uint32_t i = 0; i < nSensors; ++i) {
+                    positions->Add(Vector(x0 + coord->GetValue(0.0, areaSize), coord->GetValue(0.0, areaSize), 0.0));
+                }
+                // Gateways espaçados igualmente na linha central da área (um só fica no centro).
+                for (uint32_t g = 0; g < gatewaysPerPan; ++g) {
+                    positions->Add(Vector(x0 + areaSize * (g + 1) / (gatewaysPerPan + 1), areaSize / 2.0, 0.0));
+                }
+            }
+            mobility.SetPositionAllocator(positions);
+        }
+        mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");  // Nós fixos.
+        mobility.Install(panNodes);
+        stream += lrWpanHelper.AssignStreams(devices, stream);
+
+        // Instala a pilha de protocolos de internet (IPv6, UDP, etc.).
+        internet.Install(panNodes);
+
+        // Configura a camada 6LoWPAN sobre LrWpan.
+        NetDeviceContainer sixlowpanDevices = sixlowpan.Install(devices);
+
+        // Loga informações dos dispositivos 6LoWPAN para depuração.
+        for (uint32_t i = 0; i < sixlowpanDevices.GetN(); ++i) {
+            Ptr<SixLowPanNetDevice> dev = DynamicCast<SixLowPanNetDevice>(sixlowpanDevices.Get(i));
+            NS_LOG_INFO("6LoWPAN Device " << panNodes.Get(i)->GetId() << ": " << dev->GetAddress() << ", Link: " << (dev->IsLinkUp() ? "Up" : "Down"));
+        }
+
+        // Configura endereços IPv6 para os dispositivos, com um prefixo /64 por PAN (2001:db8:0:p::/64).
+        std::ostringstream prefix;
+        prefix << "2001:db8:0:" << std::hex << p << "::";
+        ipv6.SetBase(Ipv6Address(prefix.str().c_str()), Ipv6Prefix(64));  // Prefixo de rede.
+        Ipv6InterfaceContainer interfaces = ipv6.Assign(sixlowpanDevices);
+        if (!mesh) {
+            interfaces.SetForwarding(gatewayIndex, true);  // Habilita encaminhamento no gateway.
+            interfaces.SetDefaultRouteInAllNodes(gatewayIndex);  // Define o gateway como rota padrão.
+        } else {
+            // Malha: todos os nós encaminham e as rotas são construídas pelo RPL, com o gateway como raiz.
+            for (uint32_t i = 0; i < interfaces.GetN(); ++i) {
+                interfaces.SetForwarding(i, true);
+                Ptr<RplRouter> router = CreateObject<RplRouter>();
+                router->Setup(panNodes.Get(i)->GetId(), i == gatewayIndex, sixlowpanDevices.Get(i), interfaces.GetAddress(i, 1), rplPort);
+                router->SetTrickle(Seconds(dioIntervalMin), dioDoublings, dioRedundancy);
+                router->SetDaoInterval(Seconds(daoInterval));
+                stream += router->AssignStreams(stream);
+                router->SetStartTime(Seconds(0.0));
+                router->SetStopTime(Seconds(duration));
+                panNodes.Get(i)->AddApplication(router);
+                routers.push_back(router);
+            }
+        }
+
+        // Loga os endereços IPv6 atribuídos.
+        for (uint32_t i = 0; i < interfaces.GetN(); ++i) {
+            NS_LOG_INFO("Node " << panNodes.Get(i)->GetId() << " Address: " << interfaces.GetAddress(i, 1));
+            macDevices.push_back(DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i)));
+            globalAddresses.push_back(interfaces.GetAddress(i, 1));
+        }
+
+        // Configura a aplicação MQTT.
+        std::vector<Ipv6Address> gatewayAddresses;  // Endereços dos gateways da PAN.
+        uint32_t firstBroker = brokerApps.size();
+        for (uint32_t g = 0; g < gatewaysPerPan; ++g) {
+            gatewayAddresses.push_back(interfaces.GetAddress(gatewayIndex + g, 1));
+            NS_LOG_INFO("PAN " << p << " Gateway Address: " << gatewayAddresses.back());
+        }
+        // Configura os sensores da PAN para enviar pacotes ao seu gateway.
+        std::vector<double> panLoad(gatewaysPerPan, 0.0);
+        for (uint32_t i = 0; i < nSensors; ++i) {
+            WorkloadTrace trace = traces.empty() ? WorkloadTrace() : traces[sensorApps.size() % traces.size()];
+            uint32_t gateway = 0;
+            if (assignment == GatewayAssignment::HASH) {
+                gateway = GatewayHash(panNodes.Get(i)->GetId()) % gatewaysPerPan;
+            } else {
+                gateway = std::min_element(panLoad.begin(), panLoad.end()) - panLoad.begin();
+            }
+            panLoad[gateway] += WorkloadRate(workload, trace);
+            sensorBroker.push_back(firstBroker + gateway);
+            Ptr<MqttPublisher> app = CreateObject<MqttPublisher>();
+            app->Setup(gatewayAddresses[gateway], port, panNodes.Get(i)->GetId(), maxPackets);
+            app->SetQos(qos);
+            app->SetPayloadFormat(payload);
+            app->SetRetransmission(Seconds(retryTimeout), maxRetries);
+            app->SetCongestionWait(Seconds(congestionWait));
+            app->SetWorkload(workload, trace);
+            stream += app->AssignStreams(stream);
+            app->SetStartTime(Seconds(appStart));  // Inicia após a associação.
+            app->SetStopTime(Seconds(duration));
+            panNodes.Get(i)->AddApplication(app);
+            sensorApps.push_back(app);
+
+            // Bateria e modelo de energia do rádio do sensor.
+            Ptr<lrwpan::LrWpanNetDevice> lrWpanDev = DynamicCast<lrwpan::LrWpanNetDevice>(devices.Get(i));
+            energy::EnergySourceContainer sources = energySource.Install(panNodes.Get(i));
+            Ptr<LrWpanRadioEnergyModel> radioEnergy = CreateObject<LrWpanRadioEnergyModel>();
+            radioEnergy->SetCurrents(offCurrent, idleCurrent, rxCurrent, txCurrent);
+            radioEnergy->Attach(lrWpanDev, sources.Get(0), panNodes.Get(i)->GetId());
+            radioEnergy->SetDepletionCallback(MakeCallback(&MqttPublisher::PowerOff, app));
+            energyModels.push_back(radioEnergy);
+            // Os sensores que também assinam tópicos precisam do rádio sempre ligado.
+            if (dutyCycle && i >= nSubscribers) {
+                app->SetDutyCycle(lrWpanDev->GetMac(), Seconds(rxWindow));
+            }
+        }
+
+        // Os primeiros nSubscribers sensores da PAN também assinam tópicos no broker. Os brokers
+        // não trocam publicações entre si, então com vários gateways o assinante assina em todos.
+        for (uint32_t i = 0; i < nSubscribers; ++i) {
+            for (uint32_t g = 0; g < gatewaysPerPan; ++g) {
+                Ptr<MqttSubscriber> app = CreateObject<MqttSubscriber>();
+                app->Setup(gatewayAddresses[g], port, panNodes.Get(i)->GetId(), subscribeTopic, subscriberQos);
+                app->SetRetransmission(Seconds(retryTimeout), maxRetries);
+                app->SetCongestionWait(Seconds(congestionWait));
+                app->SetStartTime(Seconds(appStart));  // Assina junto com o início das publicações.
+                app->SetStopTime(Seconds(duration));
+                panNodes.Get(i)->AddApplication(app);
+                subscriberApps.push_back(app);
+            }
+        }
+
+        // Configura o broker MQTT-SN em cada gateway da PAN.
+        for (uint32_t g = 0; g < gatewaysPerPan; ++g) {
+            Ptr<Node> gatewayNode = panNodes.Get(gatewayIndex + g);
+            Ptr<MqttBroker> brokerApp = CreateObject<MqttBroker>();
+            brokerApp->Setup(port, gatewayNode->GetId(), Seconds(brokerDelay));  // Escuta em qualquer endereço.
+            brokerApp->SetRetransmission(Seconds(retryTimeout), maxRetries);
+            brokerApp->SetCapacity(brokerWorkers, brokerQueue, overflow);
+            if (brokerService == "exponential") {
+                brokerApp->SetExponentialService(true);
+                stream += brokerApp->AssignStreams(stream);
+            }
+            brokerApp->SetStartTime(Seconds(0.0));  // Inicia imediatamente.
+            brokerApp->SetStopTime(Seconds(duration));
+            gatewayNode->AddApplication(brokerApp);
+            brokerApps.push_back(brokerApp);
+            brokerSensors.push_back(std::count(sensorBroker.end() - nSensors, sensorBroker.end(), firstBroker + g));
+            brokerLoad.push_back(panLoad[g]);
+        }
+    }
+
+    // Restaura o snapshot: associação de cada nó e, na malha, o DODAG com as rotas descendentes.
+    if (warmStart) {
+        NS_ABORT_MSG_IF(snapshot.nodes.size() != nodes.GetN(), "Snapshot has " << snapshot.nodes.size() << " nodes, topology has " << nodes.GetN());
+        std::vector<std::map<Ipv6Address, Ipv6Address>> downward(nodes.GetN());
+        for (const SnapshotRouteRecord& route : snapshot.routes) {
+            NS_ABORT_MSG_IF(route.nodeIndex >= nodes.GetN(), "Snapshot route for unknown node " << route.nodeIndex);
+            downward[route.nodeIndex][Ipv6Address(const_cast<uint8_t*>(route.target))] = Ipv6Address(const_cast<uint8_t*>(route.nextHop));
+        }
+        for (uint32_t k = 0; k < nodes.GetN(); ++k) {
+            const SnapshotNodeRecord& record = snapshot.nodes[k];
+            NS_ABORT_MSG_IF(record.nodeId != nodes.Get(k)->GetId() ||
+                            Ipv6Address(const_cast<uint8_t*>(record.address)) != globalAddresses[k],
+                            "Snapshot addressing does not match node " << nodes.Get(k)->GetId());
+            Ptr<lrwpan::LrWpanMac> mac = macDevices[k]->GetMac();
+            uint8_t shortAddr[2] = {static_cast<uint8_t>(record.shortAddr >> 8), static_cast<uint8_t>(record.shortAddr)};
+            Mac16Address address;
+            address.CopyFrom(shortAddr);
+            mac->SetShortAddress(address);
+            mac->SetPanId(record.panId);
+            if (record.coordShortAddr != 0xFFFF) {
+                uint8_t coordAddr[2] = {static_cast<uint8_t>(record.coordShortAddr >> 8), static_cast<uint8_t>(record.coordShortAddr)};
+                Mac16Address coord;
+                coord.CopyFrom(coordAddr);
+                mac->SetAssociatedCoor(coord);
+            }
+            if (mesh) {
+                routers[k]->Restore(record.rank, Ipv6Address(const_cast<uint8_t*>(record.parent)),
+                                    Ipv6Address(const_cast<uint8_t*>(record.dodagId)), downward[k]);
+            }
+        }
+    }
+
+    // Grava o snapshot no início da fase de medição (antes de as aplicações dos sensores começarem).
+    if (!saveSnapshot.empty()) {
+        Simulator::Schedule(Seconds(appStart), [&]() {
+            NetworkSnapshot capture;
+            std::memset(&capture.header, 0, sizeof(capture.header));
+            capture.header.nSensors = nSensors;
+            capture.header.nGateways = nGateways;
+            capture.header.topology = topologyCode;
+            capture.header.rngSeed = RngSeedManager::GetSeed();
+            capture.header.rngRun = RngSeedManager::GetRun();
+            capture.header.captureTime = Simulator::Now().GetSeconds();
+            for (uint32_t k = 0; k < nodes.GetN(); ++k) {
+                SnapshotNodeRecord record;
+                std::memset(&record, 0, sizeof(record));
+                Ptr<lrwpan::LrWpanMac> mac = macDevices[k]->GetMac();
+                uint8_t buffer[2];
+                record.nodeId = nodes.Get(k)->GetId();
+                record.panId = mac->GetPanId();
+                mac->GetShortAddress().CopyTo(buffer);
+                record.shortAddr = static_cast<uint16_t>((buffer[0] << 8) | buffer[1]);
+                mac->GetCoordShortAddress().CopyTo(buffer);
+                record.coordShortAddr = static_cast<uint16_t>((buffer[0] << 8) | buffer[1]);
+                record.rank = mesh ? routers[k]->GetRank() : RplRouter::INFINITE_RANK;
+                globalAddresses[k].Serialize(record.address);
+                if (mesh) {
+                    routers[k]->GetParent().Serialize(record.parent);
+                    routers[k]->GetDodagId().Serialize(record.dodagId);
+                    for (const auto& route : routers[k]->GetDownwardRoutes()) {
+                        SnapshotRouteRecord routeRecord;
+                        routeRecord.nodeIndex = k;
+                        route.first.Serialize(routeRecord.target);
+                        route.second.Serialize(routeRecord.nextHop);
+                        capture.routes.push_back(routeRecord);
+                    }
+                }
+                capture.nodes.push_back(record);
+            }
+            if (SaveNetworkSnapshot(saveSnapshot, capture)) {
+                std::cout << "Snapshot: " << capture.nodes.size() << " nodes, " << capture.routes.size()
+                          << " routes saved to " << saveSnapshot << " at " << capture.header.captureTime << "s" << std::endl;
+            }
+        });
+    }
 
     // Configura o monitoramento de fluxo para coletar métricas de latência.
     FlowMonitorHelper flowmon;
     Ptr<FlowMonitor> monitor = flowmon.InstallAll();
+    // Histogramas de latência por fluxo e por nó, atualizados a cada pacote e gravados periodicamente.
+    LatencyCollector latency;
+    latency.Install(nodes);
+    latency.IgnorePort(rplPort);
+    if (packetTrace) {
+        NS_ABORT_MSG_UNLESS(latency.EnablePacketTrace(outputDir), "Cannot write the packet trace in " << outputDir);
+    }
+    if (kpiInterval > 0) {
+        NS_ABORT_MSG_UNLESS(latency.EnableKpi(outputDir, Seconds(kpiInterval), stopPrecision, stopMinWindows),
+                            "Cannot write kpi.csv in " << outputDir);
+    }
+    if (pcapConfig.latencyNs > 0) {
+        latency.SetLatencyCallback(MakeCallback(&PcapCapture::Latency, &pcap));
+    }
+    latency.Start(outputDir, Seconds(latencyInterval));
+
+    // Memória após a construção da topologia.
+    uint64_t rssBuiltKb = ReadProcStatusKb("VmRSS:");
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+
+    // Custo da fase de formação: tempo de relógio e eventos até appStart, o início da fase de medição.
+    // Com o snapshot carregado não há associação nem formação do DODAG a simular nesse trecho.
+    double warmupSeconds = -1.0;
+    uint64_t warmupEvents = 0;
+    auto runStart = std::chrono::steady_clock::now();
+    Simulator::Schedule(Seconds(appStart), [&]() {
+        warmupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+        warmupEvents = Simulator::GetEventCount();
+        PerfControl(perfControl, "enable");
+    });
 
     // Inicia a simulação.
     NS_LOG_INFO("Simulation starting at " << Simulator::Now().GetSeconds() << "s");
-    Simulator::Stop(Seconds(15.0));  // Para após 15s.
+    Simulator::Stop(Seconds(duration));
+    runStart = std::chrono::steady_clock::now();
     Simulator::Run();  // Executa a simulação.
+    double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    PerfControl(perfControl, "disable");
+    if (eventStats) {
+        eventProfile.Flush();
+    }
     NS_LOG_INFO("Simulation completed at " << Simulator::Now().GetSeconds() << "s");
 
+    latency.Finish();
+    pcap.Close();
+
+    // Pico de memória durante a execução.
+    uint64_t rssPeakKb = ReadProcStatusKb("VmHWM:");
+
     // Salva as métricas existentes em arquivos.
-    std::ofstream latencyFile("/ns-3-dev/output/latency.txt", std::ios::trunc);  // Arquivo para latência.
-    std::ofstream messagesSentFile("/ns-3-dev/output/messages_sent.txt", std::ios::trunc);  // Arquivo para mensagens enviadas.
-    std::ofstream energyFile("/ns-3-dev/output/energy_consumption.txt", std::ios::trunc);  // Arquivo para energia consumida.
+    std::ofstream latencyFile(outputDir + "/latency.txt", std::ios::trunc);  // Arquivo para latência.
+    std::ofstream messagesSentFile(outputDir + "/messages_sent.txt", std::ios::trunc);  // Arquivo para mensagens enviadas.
+    std::ofstream energyFile(outputDir + "/energy_consumption.txt", std::ios::trunc);  // Arquivo para energia consumida.
 
     // Coleta métricas de latência usando FlowMonitor.
     monitor->CheckForLostPackets();
@@ -378,24 +4012,275 @@ int main(int argc, char *argv[]) {
     }
     latencyFile.close();
 
-    // Coleta métricas de mensagens enviadas e energia consumida.
-    for (uint32_t i = 0; i < 10; ++i) {
-        Ptr<MqttPublisher> app = DynamicCast<MqttPublisher>(nodes.Get(i)->GetApplication(0));
+    // Coleta métricas de mensagens enviadas e energia consumida (uma linha por sensor), e o
+    // detalhamento do tempo e da energia do rádio em cada estado.
+    std::ofstream energyStatesFile(outputDir + "/energy_states.csv", std::ios::trunc);
+    energyStatesFile << "NodeID";
+    for (uint8_t state = 0; state < RADIO_STATES; ++state) {
+        energyStatesFile << "," << RadioEnergyStateName(state) << "(s)";
+    }
+    for (uint8_t state = 0; state < RADIO_STATES; ++state) {
+        energyStatesFile << "," << RadioEnergyStateName(state) << "(J)";
+    }
+    energyStatesFile << ",Total(J),AvgPower(mW),LifetimeDays,DepletedAt(s)\n";
+    double simulatedSeconds = Simulator::Now().GetSeconds();
+    double totalEnergy = 0.0;
+    double radioOnSeconds = 0.0;
+    for (uint32_t k = 0; k < sensorApps.size(); ++k) {
+        const Ptr<MqttPublisher>& app = sensorApps[k];
+        const Ptr<LrWpanRadioEnergyModel>& radioEnergy = energyModels[k];
         uint32_t sent = app->GetPacketsSent();  // Número de pacotes enviados.
         uint32_t received = app->GetPacketsReceived();  // Número de pacotes recebidos.
-        // Calcula energia: 0,01 J por pacote enviado, 0,005 J por pacote recebido.
-        double energy = (sent * 0.01) + (received * 0.005);
+        // Energia do rádio segundo o tempo passado em cada estado do transceptor.
+        double energy = radioEnergy->GetTotalEnergyConsumption();
+        // Vida útil projetada da bateria mantendo a potência média desta execução.
+        double avgPowerW = simulatedSeconds > 0 ? energy / simulatedSeconds : 0.0;
+        double lifetimeDays = avgPowerW > 0 ? initialEnergy / avgPowerW / 86400.0 : 0.0;
         messagesSentFile << sent << "\n";  // Salva mensagens enviadas.
         energyFile << energy << "\n";  // Salva energia consumida.
-        NS_LOG_INFO("Node " << i << " Sent: " << sent << ", Received: " << received << ", Energy: " << energy << " Joules");
+        energyStatesFile << app->GetNodeId();
+        for (uint8_t state = 0; state < RADIO_STATES; ++state) {
+            energyStatesFile << "," << radioEnergy->GetStateTime(state);
+        }
+        for (uint8_t state = 0; state < RADIO_STATES; ++state) {
+            energyStatesFile << "," << radioEnergy->GetStateEnergy(state);
+        }
+        energyStatesFile << "," << energy << "," << avgPowerW * 1e3 << "," << lifetimeDays << ","
+                         << (radioEnergy->IsDepleted() ? radioEnergy->GetDepletionTime().GetSeconds() : -1.0) << "\n";
+        totalEnergy += energy;
+        radioOnSeconds += simulatedSeconds - radioEnergy->GetStateTime(RADIO_OFF);
+        NS_LOG_INFO("Node " << app->GetNodeId() << " Sent: " << sent << ", Received: " << received << ", Energy: " << energy << " Joules");
     }
     messagesSentFile.close();
     energyFile.close();
+    energyStatesFile.close();
+    if (!sensorApps.empty() && simulatedSeconds > 0) {
+        double avgEnergy = totalEnergy / sensorApps.size();
+        std::cout << "Energy: " << std::fixed << std::setprecision(4) << avgEnergy << " J/sensor, radio on "
+                  << std::setprecision(1) << 100.0 * radioOnSeconds / (sensorApps.size() * simulatedSeconds)
+                  << "% of the time" << (dutyCycle ? " (duty cycling)" : "") << ", projected lifetime "
+                  << initialEnergy / (avgEnergy / simulatedSeconds) / 86400.0 << " days" << std::endl;
+    }
+
+    // Na malha, relaciona saltos até o gateway, entrega, latência e carga de encaminhamento por nó.
+    if (mesh) {
+        struct HopStats {
+            uint32_t nodes = 0;
+            uint64_t published = 0;
+            uint64_t delivered = 0;
+            uint64_t forwarded = 0;
+            double latencySumMs = 0.0;
+        };
+        std::map<uint32_t, HopStats> byHops;
+        std::ofstream meshFile(outputDir + "/mesh_nodes.csv", std::ios::trunc);
+        meshFile << "NodeID,Role,Hops,Rank,ParentChanges,Forwarded,DioSent,DaoSent,Published,Delivered,"
+                 << "DeliveryRatio,MeanLatency(ms),P99Latency(ms)\n";
+        for (uint32_t k = 0; k < routers.size(); ++k) {
+            const Ptr<RplRouter>& router = routers[k];
+            uint32_t pan = k / panSize;
+            uint32_t index = k % panSize;
+            uint32_t hops = router->GetHopCount();
+            meshFile << nodes.Get(k)->GetId() << "," << (index >= gatewayIndex ? "gateway" : "sensor") << ","
+                     << (hops == UINT32_MAX ? -1 : static_cast<int64_t>(hops)) << "," << router->GetRank() << ","
+                     << router->GetParentChanges() << "," << router->GetForwarded() << "," << router->GetDioSent() << ","
+                     << router->GetDaoSent();
+            HopStats& stats = byHops[hops];
+            stats.nodes++;
+            stats.forwarded += router->GetForwarded();
+            if (index >= gatewayIndex) {
+                meshFile << ",,,,,\n";
+                continue;
+            }
+            const Ptr<MqttPublisher>& app = sensorApps[pan * nSensors + index];
+            const LatencyHistogram* histogram = brokerApps[sensorBroker[pan * nSensors + index]]->GetTopicLatency("sensors/" + std::to_string(app->GetNodeId()));
+            uint64_t delivered = histogram ? histogram->GetCount() : 0;
+            double meanMs = histogram ? histogram->GetMeanNs() / 1e6 : 0.0;
+            meshFile << "," << app->GetPacketsSent() << "," << delivered << ","
+                     << (app->GetPacketsSent() > 0 ? static_cast<double>(delivered) / app->GetPacketsSent() : 0.0) << ","
+                     << meanMs << "," << (histogram ? histogram->GetPercentileNs(99) / 1e6 : 0.0) << "\n";
+            stats.published += app->GetPacketsSent();
+            stats.delivered += delivered;
+            stats.latencySumMs += meanMs * delivered;
+        }
+        meshFile.close();
+        std::cout << "Mesh (" << topology << "):" << std::endl;
+        for (const auto& entry : byHops) {
+            const HopStats& stats = entry.second;
+            std::cout << "  " << (entry.first == UINT32_MAX ? std::string("unjoined") : std::to_string(entry.first) + " hops")
+                      << ": " << stats.nodes << " nodes, delivery " << std::fixed << std::setprecision(1)
+                      << (stats.published > 0 ? 100.0 * stats.delivered / stats.published : 0.0) << "%, mean latency "
+                      << std::setprecision(2) << (stats.delivered > 0 ? stats.latencySumMs / stats.delivered : 0.0)
+                      << " ms, " << std::setprecision(1) << static_cast<double>(stats.forwarded) / stats.nodes
+                      << " packets forwarded/node" << std::endl;
+        }
+    }
+
+    // Carga e fila de entrada de cada gateway, para achar o joelho de mensagens/s e dimensionar os brokers.
+    std::ofstream gatewayFile(outputDir + "/gateway_stats.csv", std::ios::trunc);
+    gatewayFile << "NodeID,Pan,Workers,QueueLimit,Sensors,ExpectedLoad(msg/s),Arrivals,Served,Dropped,Rejected,"
+                << "MaxQueue,MeanWait(ms),P99Wait(ms),Utilization,ArrivalRate(msg/s),Throughput(msg/s)\n";
+    double activeSeconds = std::max(0.0, simulatedSeconds - appStart);  // Fase de medição.
+    uint64_t arrivals = 0, served = 0, dropped = 0, rejected = 0;
+    double maxUtilization = 0.0, maxWaitP99Ms = 0.0;
+    for (uint32_t b = 0; b < brokerApps.size(); ++b) {
+        const Ptr<MqttBroker>& broker = brokerApps[b];
+        const LatencyHistogram& wait = broker->GetQueueWait();
+        double waitP99Ms = wait.GetCount() > 0 ? wait.GetPercentileNs(99) / 1e6 : 0.0;
+        gatewayFile << broker->GetNodeId() << "," << b / gatewaysPerPan << "," << brokerWorkers << "," << brokerQueue << ","
+                    << brokerSensors[b] << "," << brokerLoad[b] << "," << broker->GetArrivals() << ","
+                    << broker->GetServed() << "," << broker->GetDropped() << "," << broker->GetRejected() << ","
+                    << broker->GetMaxQueue() << "," << (wait.GetCount() > 0 ? wait.GetMeanNs() / 1e6 : 0.0) << ","
+                    << waitP99Ms << "," << broker->GetUtilization() << ","
+                    << (activeSeconds > 0 ? broker->GetArrivals() / activeSeconds : 0.0) << ","
+                    << (activeSeconds > 0 ? broker->GetServed() / activeSeconds : 0.0) << "\n";
+        arrivals += broker->GetArrivals();
+        served += broker->GetServed();
+        dropped += broker->GetDropped();
+        rejected += broker->GetRejected();
+        maxUtilization = std::max(maxUtilization, broker->GetUtilization());
+        maxWaitP99Ms = std::max(maxWaitP99Ms, waitP99Ms);
+    }
+    gatewayFile.close();
+    if (activeSeconds > 0) {
+        std::cout << "Gateways: " << brokerApps.size() << " (" << gatewaysPerPan << "/PAN, " << gatewayAssign << "), "
+                  << (brokerWorkers > 0 ? std::to_string(brokerWorkers) + " workers" : std::string("no worker limit"))
+                  << ", queue " << (brokerQueue > 0 ? std::to_string(brokerQueue) : std::string("unbounded")) << " ("
+                  << brokerOverflow << "): " << std::setprecision(1) << arrivals / activeSeconds << " msg/s offered, "
+                  << served / activeSeconds << " msg/s served, " << dropped << " dropped, " << rejected
+                  << " rejected, max utilization " << 100.0 * maxUtilization << "%, worst p99 wait "
+                  << std::setprecision(2) << maxWaitP99Ms << " ms" << std::endl;
+    }
+
+    // Resume o tráfego MQTT-SN: bytes de cabeçalho x dados, retransmissões e tempo no ar.
+    uint64_t mqttBytes = 0;
+    uint64_t mqttPayloadBytes = 0;
+    uint64_t retransmissions = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t delivered = 0;
+    for (const Ptr<MqttPublisher>& app : sensorApps) {
+        mqttBytes += app->GetBytesSent();
+        mqttPayloadBytes += app->GetPayloadBytesSent();
+        retransmissions += app->GetRetransmissions();
+        completed += app->GetPublishesCompleted();
+        failed += app->GetPublishesFailed();
+    }
+    for (const Ptr<MqttSubscriber>& app : subscriberApps) {
+        mqttBytes += app->GetBytesSent();
+        retransmissions += app->GetRetransmissions();
+        delivered += app->GetMessagesDelivered();
+    }
+    for (const Ptr<MqttBroker>& app : brokerApps) {
+        mqttBytes += app->GetBytesSent();
+        mqttPayloadBytes += app->GetPayloadBytesSent();
+        retransmissions += app->GetRetransmissions();
+    }
+    std::cout << "MQTT-SN (QoS " << qos << "): " << mqttBytes << " bytes sent, "
+              << (mqttBytes - mqttPayloadBytes) << " header/control + " << mqttPayloadBytes << " payload ("
+              << std::fixed << std::setprecision(1)
+              << (mqttBytes > 0 ? 100.0 * (mqttBytes - mqttPayloadBytes) / mqttBytes : 0.0) << "% overhead), "
+              << retransmissions << " retransmissions, " << completed << " publishes completed, "
+              << failed << " failed, " << delivered << " delivered to subscribers" << std::endl;
+    std::cout << "Airtime: " << airtime.GetFrames() << " frames, " << airtime.GetBytes() << " PSDU bytes, "
+              << std::setprecision(3) << airtime.GetAirtime().GetSeconds() << " s on air" << std::endl;
 
-    // Fecha o arquivo CSV de logs.
-    CloseLogCsv();
+    // Fecha o log de eventos e reporta o custo por evento dentro da simulação.
+    eventLog.Close();
+    std::cout << "Event log (" << eventLogMode << "): " << eventLog.GetEventCount() << " events, "
+              << std::fixed << std::setprecision(1) << eventLog.GetNsPerEvent() << " ns/event in-sim, "
+              << eventLog.GetStallCount() << " writer stalls" << std::endl;
+    // Gera o logs.csv a partir do log binário.
+    if (binaryLog && convertToCsv) {
+        ConvertEventLogToCsv(eventLog.GetPath(), outputDir + "/logs.csv");
+    }
+
+    // Vazão do simulador: eventos executados por segundo de tempo de relógio.
+    uint64_t simEvents = Simulator::GetEventCount();
+    std::cout << "Simulation: " << simEvents << " events in " << std::setprecision(3) << runSeconds << " s wall ("
+              << std::setprecision(0) << (runSeconds > 0 ? simEvents / runSeconds : 0.0) << " events/s, payload "
+              << payloadFormat << ", scheduler " << scheduler << ")" << std::endl;
+
+    // Custo da captura PCAP: quadros gravados e tempo de relógio gasto no trace, nos buffers e no fechamento.
+    if (pcap.IsEnabled()) {
+        std::cout << "PCAP capture: " << pcap.GetFramesWritten() << " of " << pcap.GetFramesSeen() << " frames from "
+                  << pcap.GetFileCount() << " devices";
+        if (pcapConfig.latencyNs > 0) {
+            std::cout << " (" << pcap.GetTriggers() << " latency triggers)";
+        }
+        std::cout << ", " << std::fixed << std::setprecision(2) << pcap.GetBytesWritten() / 1e6 << " MB written, "
+                  << pcap.GetDiskBytes() / 1e6 << " MB on disk, " << std::setprecision(1) << pcap.GetWallSeconds() * 1e3
+                  << " ms wall (" << (runSeconds > 0 ? 100.0 * pcap.GetWallSeconds() / runSeconds : 0.0)
+                  << "% of the run)" << std::endl;
+        if (pcap.GetFailedFiles() > 0) {
+            std::cout << "PCAP capture: " << pcap.GetFailedFiles() << " files incomplete (write error or gzip failure)"
+                      << std::endl;
+        }
+    }
+
+    // Fila de eventos: totais e tempo de relógio por tipo de evento, do mais caro ao mais barato.
+    if (eventStats) {
+        std::vector<std::pair<std::type_index, EventQueueProfile::TypeStats>> types(eventProfile.types.begin(),
+                                                                                   eventProfile.types.end());
+        std::sort(types.begin(), types.end(), [](const auto& a, const auto& b) { return a.second.wallNs > b.second.wallNs; });
+        uint64_t totalNs = 0;
+        for (const auto& type : types) {
+            totalNs += type.second.wallNs;
+        }
+        std::ofstream eventFile(outputDir + "/event_stats.csv", std::ios::trunc);
+        eventFile << "Type,Executed,Wall(ms),MeanWall(us),Share(%)\n";
+        for (const auto& type : types) {
+            eventFile << "\"" << DemangleEventType(type.first) << "\"," << type.second.executed << ","
+                      << type.second.wallNs / 1e6 << "," << type.second.wallNs / 1e3 / type.second.executed << ","
+                      << (totalNs ? 100.0 * type.second.wallNs / totalNs : 0.0) << "\n";
+        }
+        std::cout << "Event queue (" << scheduler << "): " << eventProfile.scheduled << " scheduled, "
+                  << eventProfile.executed << " executed (" << eventProfile.cancelled << " cancelled), "
+                  << eventProfile.removed << " removed, max depth " << eventProfile.maxDepth << ", "
+                  << types.size() << " event types in event_stats.csv" << std::endl;
+    }
+
+    // Tempo até a fase de medição, para comparar execuções com e sem snapshot.
+    if (warmupSeconds >= 0.0) {
+        std::cout << "Startup (" << (warmStart ? "snapshot " + loadSnapshot : std::string("no snapshot")) << "): build "
+                  << std::setprecision(3) << buildSeconds << " s, warm-up to " << appStart << " s simulated "
+                  << warmupSeconds << " s wall (" << warmupEvents << " events), total "
+                  << buildSeconds + warmupSeconds << " s" << std::endl;
+    }
+    // Execução encerrada antes de --duration pela convergência dos KPIs.
+    if (!latency.GetConvergenceTime().IsZero()) {
+        std::cout << "Stopped early at " << std::setprecision(3) << latency.GetConvergenceTime().GetSeconds() << " s of "
+                  << duration << " s: windowed KPIs within " << stopPrecision * 100 << "% (95% CI)" << std::endl;
+    }
+
+    // Reporta o custo de memória da topologia e da execução, total e por nó.
+    // Diferenças com sinal: o RSS pode diminuir após a construção, e a leitura do /proc pode falhar (0).
+    uint32_t totalNodes = nodes.GetN();
+    int64_t buildRssKb = static_cast<int64_t>(rssBuiltKb) - static_cast<int64_t>(rssStartKb);
+    int64_t peakAboveStartKb = static_cast<int64_t>(rssPeakKb) - static_cast<int64_t>(rssStartKb);
+    std::cout << "Memory: " << totalNodes << " nodes (" << nGateways << " PANs x " << panSize << "), "
+              << "build " << buildRssKb << " kB (" << std::setprecision(2)
+              << static_cast<double>(buildRssKb) / totalNodes << " kB/node), "
+              << "peak RSS " << rssPeakKb << " kB (" << static_cast<double>(peakAboveStartKb) / totalNodes
+              << " kB/node above baseline)" << std::endl;
+
+    // Velocidade, memória e KPIs da execução, no mesmo esquema do run_stats.csv do cenário de QoS
+    // (usado pelo sweep/benchmark.py).
+    // StartupSeconds vai até a fase de medição (construção e aquecimento até appStart), o custo que o
+    // snapshot evita; se a execução terminou antes do appStart, todo o Run conta como aquecimento.
+    const LatencyHistogram& totalLatency = latency.GetTotalLatency();
+    double startupSeconds = buildSeconds + (warmupSeconds >= 0.0 ? warmupSeconds : runSeconds);
+    std::ofstream runStats(outputDir + "/run_stats.csv", std::ios::trunc);
+    runStats << "Sensors,Gateways,Nodes,SimSeconds,WallSeconds,SimPerWall,Events,EventsPerSecond,BuildRssKb,PeakRssKb,"
+             << "StartupSeconds,TxPackets,RxPackets,DeliveryRatio,MeanDelay(ms),P99Delay(ms)\n";
+    runStats << nSensors << "," << nGateways << "," << totalNodes << "," << simulatedSeconds << ","
+             << runSeconds << "," << (runSeconds > 0 ? simulatedSeconds / runSeconds : 0.0) << "," << simEvents << ","
+             << (runSeconds > 0 ? simEvents / runSeconds : 0.0) << "," << buildRssKb << ","
+             << rssPeakKb << "," << startupSeconds << "," << latency.GetTxPackets() << "," << totalLatency.GetCount() << ","
+             << (latency.GetTxPackets() ? static_cast<double>(totalLatency.GetCount()) / latency.GetTxPackets() : 0.0) << ","
+             << totalLatency.GetMeanNs() / 1e6 << "," << totalLatency.GetPercentileNs(99) / 1e6 << "\n";
+    runStats.close();
 
     // Finaliza a simulação, liberando recursos.
     Simulator::Destroy();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,3 +1,5 @@
+import argparse
+import sqlite3
 import pandas as pd
 import matplotlib.pyplot as plt
 import seaborn as sns
@@ -7,9 +9,25 @@ import os
 plt.style.use('seaborn')
 sns.set_palette("colorblind")
 
+# Fonte dos dados: o simulation_results.csv de uma execução ou, com --db, todas as execuções
+# de uma varredura (sweep/run_sweep.py). Com várias execuções, as barras mostram a média e o
+# intervalo de confiança de 95% entre sementes. --results também aceita o flow_summary.csv do
+# sweep/packet_summary.py (mesmas colunas, mais os percentis de atraso).
+parser = argparse.ArgumentParser(description="Gera os gráficos do cenário de QoS")
+parser.add_argument("--results", default="/ns-3-dev/output/simulation_results.csv",
+                    help="simulation_results.csv ou flow_summary.csv (sweep/packet_summary.py)")
+parser.add_argument("--db", help="banco SQLite de uma varredura (sweep/run_sweep.py)")
+parser.add_argument("--where", default="1", help="filtro SQL sobre a tabela runs")
+args = parser.parse_args()
+
 # Carrega os dados
-results_file = "/ns-3-dev/output/simulation_results.csv"
-df = pd.read_csv(results_file)
+if args.db:
+    con = sqlite3.connect(args.db)
+    df = pd.read_sql("SELECT f.* FROM qos_flows f JOIN runs r ON r.run_id = f.run_id "
+                     f"WHERE r.scenario = 'qos' AND r.status = 0 AND ({args.where})", con)
+    con.close()
+else:
+    df = pd.read_csv(args.results)
 
 # Cria diretório para os gráficos
 os.makedirs("/ns-3-dev/output/plots", exist_ok=True)
@@ -62,4 +80,14 @@ for i, (metric, title) in enumerate(zip(metrics, titles), 1):
 
 save_plot(plt, "dscp_comparison.png")
 
+# Gráfico 5: Percentis de Atraso por Fluxo (só com o flow_summary.csv)
+if 'P99Delay(ms)' in df.columns:
+    percentiles = df.melt(id_vars=['FlowID'], value_vars=['P50Delay(ms)', 'P90Delay(ms)', 'P99Delay(ms)'],
+                          var_name='Percentil', value_name='Atraso (ms)')
+    plt.figure(figsize=(10, 6))
+    sns.barplot(x='FlowID', y='Atraso (ms)', hue='Percentil', data=percentiles)
+    plt.title("Percentis de Atraso por Fluxo")
+    plt.xlabel("ID do Fluxo")
+    save_plot(plt, "delay_percentiles.png")
+
 print("Análise concluída. Gráficos salvos em /ns-3-dev/output/plots/")
\ No newline at end of file
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+# Benchmark de regressão de desempenho dos dois cenários: roda o sixlowpan_mqtt_simulation e o
+# video_streaming_qos com semente fixa em três escalas (small, medium, large), uma execução por
+# vez, e lê o run_stats.csv de cada uma: tempo de relógio da simulação, eventos, eventos/s, pico de
+# RSS e os KPIs da rede (taxa de entrega, atraso médio e p99). O resultado é comparado com uma
+# referência gravada antes (--save-baseline): o desempenho pode piorar até --perf-tolerance, e os
+# KPIs, que com a mesma semente não deveriam mudar, até --kpi-tolerance. Qualquer regressão faz o
+# script sair com código 1.
+#
+# Exemplo (dentro do container, em /ns-3-dev):
+#   python3 sweep/benchmark.py --save-baseline            # grava a referência (antes da mudança)
+#   python3 sweep/benchmark.py                            # compara com ela (depois da mudança)
+#   python3 sweep/benchmark.py --scenarios qos --scales small,medium --repeat 5
+
+import argparse
+import csv
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import time
+
+from run_sweep import SCENARIOS, resolve_executable
+
+SEED = ["--RngSeed=1", "--RngRun=1"]
+
+# Argumentos fixos de cada cenário (sem logs no terminal nem conversões pós-simulação) e de cada escala.
+COMMON = {
+    "iot": ["--verbose=false", "--convertLog=false", "--latencyInterval=0", "--maxPackets=100", "--duration=60"],
+    "qos": ["--latencyInterval=0", "--queueStatsCsv=false", "--duration=10"],
+}
+SUITE = {
+    ("iot", "small"): ["--nSensors=10", "--nGateways=1"],
+    ("iot", "medium"): ["--nSensors=50", "--nGateways=2"],
+    ("iot", "large"): ["--nSensors=100", "--nGateways=4", "--topology=grid"],
+    ("qos", "small"): ["--nClients=2", "--nRouters=2"],
+    ("qos", "medium"): ["--nClients=50", "--nRouters=2"],
+    ("qos", "large"): ["--nClients=200", "--nRouters=7", "--topology=tree"],
+}
+
+# Métricas comparadas com a referência: (coluna do run_stats.csv, tipo, sentido da piora).
+# "perf" depende da máquina e só conta quando piora (+1: maior é pior, -1: menor é pior);
+# "kpi" é determinístico com a semente fixa, e qualquer desvio conta.
+METRICS = [
+    ("WallSeconds", "perf", +1),
+    ("EventsPerSecond", "perf", -1),
+    ("PeakRssKb", "perf", +1),
+    ("Events", "kpi", 0),
+    ("DeliveryRatio", "kpi", 0),
+    ("MeanDelay(ms)", "kpi", 0),
+    ("P99Delay(ms)", "kpi", 0),
+]
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "benchmark_baseline.json")
+
+
+# Roda um caso --repeat vezes e resume: mediana das métricas de desempenho e os KPIs, que devem
+# ser idênticos em todas as repetições.
+def run_case(executable, ns3_dir, env, outdir, args, repeat):
+    samples = []
+    for i in range(repeat):
+        run_dir = os.path.join(outdir, f"repeat-{i}")
+        os.makedirs(run_dir, exist_ok=True)
+        start = time.monotonic()
+        with open(os.path.join(run_dir, "stdout.txt"), "w") as log:
+            code = subprocess.run([executable, f"--outputDir={run_dir}"] + args, cwd=ns3_dir, env=env,
+                                  stdout=log, stderr=subprocess.STDOUT).returncode
+        if code != 0:
+            print(f"  falha (código {code}, {time.monotonic() - start:.1f}s), veja {run_dir}/stdout.txt", file=sys.stderr)
+            return None, False
+        with open(os.path.join(run_dir, "run_stats.csv"), newline="") as f:
+            samples.append({k: float(v) for k, v in next(csv.DictReader(f)).items()})
+    result = {}
+    deterministic = True
+    for name, kind, _ in METRICS:
+        values = [s[name] for s in samples]
+        if kind == "perf":
+            result[name] = statistics.median(values)
+        else:
+            result[name] = values[0]
+            deterministic = deterministic and all(v == values[0] for v in values)
+    return result, deterministic
+
+
+# Variação relativa de value em relação a reference.
+def relative(value, reference):
+    if reference == 0:
+        return 0.0 if value == 0 else float("inf")
+    return (value - reference) / abs(reference)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark de regressão de desempenho dos cenários IoT e QoS")
+    parser.add_argument("--scenarios", default="iot,qos", help="cenários, separados por vírgula")
+    parser.add_argument("--scales", default="small,medium,large", help="escalas, separadas por vírgula")
+    parser.add_argument("--repeat", type=int, default=3, help="execuções de cada caso (mediana do desempenho)")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE, help="arquivo JSON da referência")
+    parser.add_argument("--save-baseline", action="store_true", help="grava os resultados como referência em vez de comparar")
+    parser.add_argument("--perf-tolerance", type=float, default=0.10, help="piora relativa aceita no desempenho")
+    parser.add_argument("--kpi-tolerance", type=float, default=0.001, help="desvio relativo aceito nos KPIs")
+    parser.add_argument("--ns3-dir", default="/ns-3-dev")
+    parser.add_argument("--out", default=None, help="diretório das execuções (padrão: output/benchmark)")
+    args = parser.parse_args()
+
+    scenarios = [s for s in args.scenarios.split(",") if s]
+    scales = [s for s in args.scales.split(",") if s]
+    cases = [(scenario, scale) for scenario in scenarios for scale in scales if (scenario, scale) in SUITE]
+    if not cases:
+        print("Nenhum caso selecionado", file=sys.stderr)
+        return 1
+    out = os.path.abspath(args.out or os.path.join(args.ns3_dir, "output", "benchmark"))
+    os.makedirs(out, exist_ok=True)
+    env = dict(os.environ)
+    env["LD_LIBRARY_PATH"] = os.path.join(args.ns3_dir, "build", "lib") + ":" + env.get("LD_LIBRARY_PATH", "")
+    executables = {scenario: resolve_executable(args.ns3_dir, SCENARIOS[scenario]) for scenario in scenarios}
+
+    results = {}
+    failed = False
+    print(f"{'Caso':<12} {'Relógio(s)':>10} {'Eventos':>11} {'Eventos/s':>10} {'Pico RSS(MB)':>12} "
+          f"{'Entrega':>8} {'Atraso(ms)':>10} {'p99(ms)':>8}")
+    for scenario, scale in cases:
+        name = f"{scenario}-{scale}"
+        case_args = SEED + COMMON[scenario] + SUITE[(scenario, scale)]
+        result, deterministic = run_case(executables[scenario], args.ns3_dir, env, os.path.join(out, name),
+                                         case_args, max(args.repeat, 1))
+        if result is None:
+            failed = True
+            continue
+        if not deterministic:
+            print(f"  {name}: KPIs diferentes entre repetições com a mesma semente", file=sys.stderr)
+            failed = True
+        results[name] = {"args": case_args, "metrics": result}
+        print(f"{name:<12} {result['WallSeconds']:>10.2f} {result['Events']:>11.0f} {result['EventsPerSecond']:>10.0f} "
+              f"{result['PeakRssKb'] / 1024:>12.1f} {result['DeliveryRatio']:>8.4f} {result['MeanDelay(ms)']:>10.3f} "
+              f"{result['P99Delay(ms)']:>8.3f}")
+
+    with open(os.path.join(out, "benchmark.csv"), "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["Case"] + [name for name, _, _ in METRICS])
+        for name, case in results.items():
+            writer.writerow([name] + [case["metrics"][metric] for metric, _, _ in METRICS])
+
+    if args.save_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump({"host": platform.node(), "created": time.strftime("%Y-%m-%d %H:%M:%S"), "cases": results},
+                      f, indent=2)
+        print(f"Referência gravada em {args.baseline}")
+        return 1 if failed else 0
+
+    if not os.path.exists(args.baseline):
+        print(f"Sem referência em {args.baseline}; grave uma com --save-baseline", file=sys.stderr)
+        return 1
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    print(f"\nComparação com {args.baseline} (gravada em {baseline.get('host', '?')}, {baseline.get('created', '?')}):")
+    for name, case in results.items():
+        reference = baseline["cases"].get(name)
+        if reference is None:
+            print(f"  {name}: sem referência")
+            continue
+        if reference["args"] != case["args"]:
+            print(f"  {name}: argumentos diferentes da referência, grave uma nova com --save-baseline")
+            failed = True
+            continue
+        for metric, kind, worse in METRICS:
+            old, new = reference["metrics"][metric], case["metrics"][metric]
+            change = relative(new, old)
+            if kind == "perf":
+                regression = worse * change > args.perf_tolerance
+            else:
+                regression = abs(change) > args.kpi_tolerance
+            if regression or change != 0:
+                status = "REGRESSÃO" if regression else "ok"
+                print(f"  {name:<12} {metric:<16} {old:>14.6g} -> {new:<14.6g} {100 * change:>+8.2f}%  {status}")
+            failed = failed or regression
+    print("Falhou" if failed else "Sem regressões")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
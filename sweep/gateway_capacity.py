@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Capacidade dos gateways do cenário IoT: roda o sixlowpan_mqtt_simulation com carga crescente
+# (por padrão, diminuindo o período das publicações), uma execução por vez, e lê o
+# gateway_stats.csv de cada uma. O joelho é a maior carga antes da primeira em que os brokers
+# perdem (descartam ou rejeitam) mais que --loss das mensagens ou em que o p99 da espera na fila
+# passa de --max-wait ms.
+#
+# Exemplo (dentro do container, em /ns-3-dev):
+#   python3 sweep/gateway_capacity.py --param period=2,1,0.5,0.2,0.1,0.05 -- \
+#       --nSensors=50 --brokerWorkers=2 --brokerDelay=0.005 --brokerQueue=50 --duration=60
+#
+# Argumentos depois de "--" são repassados à simulação.
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import time
+
+from run_sweep import SCENARIOS, parse_param, resolve_executable
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Joelho de mensagens/s dos gateways do cenário IoT")
+    parser.add_argument("--param", default="period=2,1,0.5,0.2,0.1",
+                        help="parâmetro variado, em ordem crescente de carga (nome=v1,v2,...)")
+    parser.add_argument("--loss", type=float, default=0.01, help="fração máxima de mensagens descartadas/rejeitadas")
+    parser.add_argument("--max-wait", type=float, default=100.0, help="p99 máximo da espera na fila (ms)")
+    parser.add_argument("--ns3-dir", default="/ns-3-dev")
+    parser.add_argument("--out", default=None, help="diretório das execuções (padrão: output/gateway_capacity)")
+    parser.add_argument("extra", nargs="*", help="argumentos repassados à simulação (depois de --)")
+    args = parser.parse_args()
+
+    name, values = parse_param(args.param)
+    out = os.path.abspath(args.out or os.path.join(args.ns3_dir, "output", "gateway_capacity"))
+    os.makedirs(out, exist_ok=True)
+    executable = resolve_executable(args.ns3_dir, SCENARIOS["iot"])
+    env = dict(os.environ)
+    env["LD_LIBRARY_PATH"] = os.path.join(args.ns3_dir, "build", "lib") + ":" + env.get("LD_LIBRARY_PATH", "")
+
+    rows = []
+    knee = None
+    saturated = False
+    print(f"{name:>10} {'Chegadas/s':>10} {'Atendidas/s':>11} {'Perda(%)':>8} {'Util.máx(%)':>11} {'p99 espera(ms)':>14}")
+    for value in values:
+        outdir = os.path.join(out, f"{name}-{value}")
+        os.makedirs(outdir, exist_ok=True)
+        cmd = [executable, "--workload=periodic", f"--{name}={value}", f"--outputDir={outdir}", "--verbose=false",
+               "--latencyInterval=0", "--convertLog=false"] + args.extra
+        start = time.monotonic()
+        with open(os.path.join(outdir, "stdout.txt"), "w") as log:
+            code = subprocess.run(cmd, cwd=args.ns3_dir, env=env, stdout=log, stderr=subprocess.STDOUT).returncode
+        if code != 0:
+            print(f"  falha com {name}={value} (código {code}, {time.monotonic() - start:.1f}s), "
+                  f"veja {outdir}/stdout.txt", file=sys.stderr)
+            continue
+        with open(os.path.join(outdir, "gateway_stats.csv"), newline="") as f:
+            brokers = list(csv.DictReader(f))
+        arrivals = sum(int(b["Arrivals"]) for b in brokers)
+        lost = sum(int(b["Dropped"]) + int(b["Rejected"]) for b in brokers)
+        row = {
+            name: value,
+            "Gateways": len(brokers),
+            "ArrivalRate(msg/s)": sum(float(b["ArrivalRate(msg/s)"]) for b in brokers),
+            "Throughput(msg/s)": sum(float(b["Throughput(msg/s)"]) for b in brokers),
+            "LossRatio": lost / arrivals if arrivals else 0.0,
+            "MaxUtilization": max((float(b["Utilization"]) for b in brokers), default=0.0),
+            "P99Wait(ms)": max((float(b["P99Wait(ms)"]) for b in brokers), default=0.0),
+        }
+        rows.append(row)
+        print(f"{value:>10} {row['ArrivalRate(msg/s)']:>10.1f} {row['Throughput(msg/s)']:>11.1f} "
+              f"{100 * row['LossRatio']:>8.2f} {100 * row['MaxUtilization']:>11.1f} {row['P99Wait(ms)']:>14.2f}")
+        if not saturated and (row["LossRatio"] > args.loss or row["P99Wait(ms)"] > args.max_wait):
+            saturated = True
+        elif not saturated:
+            knee = row
+
+    if not rows:
+        return 1
+    with open(os.path.join(out, "capacity.csv"), "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=list(rows[0].keys()))
+        writer.writeheader()
+        writer.writerows(rows)
+    if knee is None:
+        print("Os gateways já saturam na menor carga testada")
+    elif not saturated:
+        print(f"Sem saturação até {name}={knee[name]} ({knee['Throughput(msg/s)']:.1f} msg/s); aumente a carga")
+    else:
+        print(f"Joelho: {name}={knee[name]}, {knee['Throughput(msg/s)']:.1f} msg/s atendidas "
+              f"({knee['Gateways']} gateways, utilização máxima {100 * knee['MaxUtilization']:.0f}%)")
+    print(f"Resultados em {os.path.join(out, 'capacity.csv')}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
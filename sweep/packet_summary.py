@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+# Resume o packets.bin (gravado com --packetTrace) de uma ou mais execuções, dos dois cenários,
+# em uma única passada e com memória limitada: os blocos do arquivo são lidos um por vez, coluna a
+# coluna, com numpy, e cada bloco só atualiza contadores e histogramas de atraso por fluxo, por nó
+# de origem e por execução. Os histogramas são os mesmos do LatencyHistogram dos cenários (16
+# sub-buckets por potência de dois, erro relativo de até 1/16 nos percentis).
+#
+# Tabelas geradas no diretório de saída:
+#   flow_summary.csv  por fluxo, com as colunas do simulation_results.csv (analyze_results.py --results)
+#   node_summary.csv  por nó de origem (plot_metrics.py)
+#   run_summary.csv   uma linha por execução
+#
+# Exemplos (dentro do container, em /ns-3-dev):
+#   python3 sweep/packet_summary.py output
+#   python3 sweep/packet_summary.py output/sweeps/qos/point-*/run-* --out output/sweeps/summary
+#
+# O formato do packets.bin está descrito no sweep/Readme.md e é gravado pelo sweep/packet_trace.h.
+
+import argparse
+import csv
+import glob
+import math
+import os
+import struct
+import sys
+
+import numpy as np
+
+HEADER = struct.Struct("<8sII")  # PacketTraceHeader: magic, version, blockRecords
+BLOCK = struct.Struct("<II")  # PacketBlockHeader: records, reserved
+PACKET_TRACE_VERSION = 1  # O mesmo do sweep/packet_trace.h, o escritor dos dois cenários.
+SUB_BUCKET_BITS = 4
+PERCENTILES = (50, 90, 99)
+
+METRICS = ["TxPackets", "RxPackets", "TxBytes", "RxBytes", "Throughput(Mbps)", "AvgDelay(ms)",
+           "P50Delay(ms)", "P90Delay(ms)", "P99Delay(ms)", "MaxDelay(ms)", "PacketLossRate(%)"]
+
+
+# Índice do bucket de cada atraso em ns (LatencyHistogram::BucketIndex, vetorizado).
+def bucket_index(values):
+    values = np.maximum(values, 0)
+    exponent = np.frexp(values.astype(np.float64))[1] - 1  # floor(log2(v)) para v >= 1
+    shift = np.maximum(exponent - SUB_BUCKET_BITS, 0)
+    index = (shift << SUB_BUCKET_BITS) + (values >> shift)
+    return np.where(values < (1 << SUB_BUCKET_BITS), values, index)
+
+
+# Menor valor do bucket index (LatencyHistogram::BucketLow).
+def bucket_low(index):
+    if index < (2 << SUB_BUCKET_BITS):
+        return index
+    shift = (index >> SUB_BUCKET_BITS) - 1
+    return (index - (shift << SUB_BUCKET_BITS)) << shift
+
+
+# Percentil p de um histograma, aproximado pelo maior valor do bucket (como nos cenários).
+def percentile(histogram, count, p, max_value):
+    if count == 0:
+        return 0
+    rank = max(1, math.ceil(p / 100.0 * count))
+    index = int(np.searchsorted(np.cumsum(histogram), rank))
+    return min(bucket_low(index + 1) - 1, max_value)
+
+
+class Groups:
+    """Contadores e histogramas de atraso de um conjunto de chaves densas 0..n-1 (fluxos ou nós)."""
+
+    def __init__(self):
+        self.size = 0
+        self.tx_packets = np.zeros(0, np.int64)
+        self.rx_packets = np.zeros(0, np.int64)
+        self.tx_bytes = np.zeros(0, np.float64)
+        self.rx_bytes = np.zeros(0, np.float64)
+        self.delay_sum = np.zeros(0, np.float64)
+        self.delay_max = np.zeros(0, np.int64)
+        self.first_rx = np.zeros(0, np.int64)
+        self.last_rx = np.zeros(0, np.int64)
+        self.histograms = np.zeros((0, 0), np.int64)
+
+    def grow(self, size, buckets):
+        size = max(size, self.size)
+        buckets = max(buckets, self.histograms.shape[1])
+        if size == self.size and buckets == self.histograms.shape[1]:
+            return
+        extra = size - self.size
+        for name, fill in (("tx_packets", 0), ("rx_packets", 0), ("tx_bytes", 0), ("rx_bytes", 0),
+                           ("delay_sum", 0), ("delay_max", 0), ("first_rx", np.iinfo(np.int64).max),
+                           ("last_rx", -1)):
+            column = getattr(self, name)
+            setattr(self, name, np.concatenate([column, np.full(extra, fill, column.dtype)]))
+        histograms = np.zeros((size, buckets), np.int64)
+        histograms[:self.size, :self.histograms.shape[1]] = self.histograms
+        self.histograms = histograms
+        self.size = size
+
+    def add(self, keys, time, delay, nbytes):
+        sent = delay < 0
+        received = ~sent
+        rx_keys = keys[received]
+        rx_delay = delay[received]
+        buckets = bucket_index(rx_delay)
+        self.grow(int(keys.max()) + 1 if len(keys) else 0, int(buckets.max()) + 1 if len(buckets) else 0)
+        n = self.size
+        self.tx_packets += np.bincount(keys[sent], minlength=n)
+        self.tx_bytes += np.bincount(keys[sent], weights=nbytes[sent], minlength=n)
+        if len(rx_keys) == 0:
+            return
+        self.rx_packets += np.bincount(rx_keys, minlength=n)
+        self.rx_bytes += np.bincount(rx_keys, weights=nbytes[received], minlength=n)
+        self.delay_sum += np.bincount(rx_keys, weights=rx_delay, minlength=n)
+        np.maximum.at(self.delay_max, rx_keys, rx_delay)
+        np.minimum.at(self.first_rx, rx_keys, time[received])
+        np.maximum.at(self.last_rx, rx_keys, time[received])
+        width = self.histograms.shape[1]
+        self.histograms += np.bincount(rx_keys * width + buckets, minlength=n * width).reshape(n, width)
+
+    # Métricas da chave i, na ordem de METRICS.
+    def metrics(self, i):
+        tx, rx = int(self.tx_packets[i]), int(self.rx_packets[i])
+        span = (self.last_rx[i] - self.first_rx[i]) / 1e9 if rx > 0 else 0.0
+        throughput = self.rx_bytes[i] * 8.0 / span / 1e6 if span > 0 else 0.0
+        mean = self.delay_sum[i] / rx / 1e6 if rx > 0 else 0.0
+        max_delay = int(self.delay_max[i])
+        percentiles = [percentile(self.histograms[i], rx, p, max_delay) / 1e6 for p in PERCENTILES]
+        loss = (tx - rx) * 100.0 / tx if tx > rx else 0.0
+        return [tx, rx, int(self.tx_bytes[i]), int(self.rx_bytes[i]), throughput, mean] + percentiles + \
+               [max_delay / 1e6, loss]
+
+
+# Lê os blocos de um packets.bin: (instante, atraso, fluxo, nó, bytes) de um bloco por vez.
+def read_blocks(path):
+    with open(path, "rb") as f:
+        magic, version, _ = HEADER.unpack(f.read(HEADER.size))
+        if magic != b"PKTTRACE" or version != PACKET_TRACE_VERSION:
+            raise ValueError(f"{path} não é um packets.bin válido")
+        while True:
+            head = f.read(BLOCK.size)
+            if len(head) < BLOCK.size:
+                return
+            records = BLOCK.unpack(head)[0]
+            columns = [np.fromfile(f, dtype, records) for dtype in ("<i8", "<i8", "<u4", "<u4", "<u4")]
+            if any(len(column) < records for column in columns):
+                print(f"  {path}: último bloco incompleto ignorado", file=sys.stderr)
+                return
+            yield columns
+
+
+# Resume uma execução (todos os packets*.bin do diretório, um por rank em execuções distribuídas;
+# os fluxos são unidos pelo nome).
+def summarize_run(run_dir):
+    flow_ids = {}  # nome -> índice denso
+    flow_info = []  # (nome, DSCP)
+    flows, nodes, total = Groups(), Groups(), Groups()
+    traces = sorted(glob.glob(os.path.join(run_dir, "packets*.bin")))
+    for trace in traces:
+        suffix = os.path.basename(trace)[len("packets"):-len(".bin")]
+        lookup = []
+        with open(os.path.join(run_dir, f"packet_flows{suffix}.csv"), newline="") as f:
+            for row in csv.DictReader(f):
+                name = row["Name"]
+                if name not in flow_ids:
+                    flow_ids[name] = len(flow_info)
+                    flow_info.append((name, int(row["DSCP"])))
+                lookup.append(flow_ids[name])
+        lookup = np.array(lookup, np.int64)
+        for time, delay, flow, node, nbytes in read_blocks(trace):
+            nbytes = nbytes.astype(np.float64)
+            flows.add(lookup[flow], time, delay, nbytes)
+            nodes.add(node.astype(np.int64), time, delay, nbytes)
+            total.add(np.zeros(len(time), np.int64), time, delay, nbytes)
+    return traces, flow_info, flows, nodes, total
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Resumo por fluxo, nó e execução do packets.bin")
+    parser.add_argument("runs", nargs="+", help="diretórios de saída das execuções (--outputDir)")
+    parser.add_argument("--out", default=None, help="diretório das tabelas (padrão: o da execução, se for uma só)")
+    args = parser.parse_args()
+
+    out = args.out or (args.runs[0] if len(args.runs) == 1 else ".")
+    os.makedirs(out, exist_ok=True)
+    with open(os.path.join(out, "flow_summary.csv"), "w", newline="") as flow_file, \
+            open(os.path.join(out, "node_summary.csv"), "w", newline="") as node_file, \
+            open(os.path.join(out, "run_summary.csv"), "w", newline="") as run_file:
+        flow_writer, node_writer, run_writer = csv.writer(flow_file), csv.writer(node_file), csv.writer(run_file)
+        flow_writer.writerow(["Run", "FlowID", "Name", "Protocol", "DSCP"] + METRICS)
+        node_writer.writerow(["Run", "NodeID"] + METRICS)
+        run_writer.writerow(["Run", "Flows", "Nodes"] + METRICS)
+        summarized = 0
+        for run_dir in args.runs:
+            traces, flow_info, flows, nodes, total = summarize_run(run_dir)
+            if not traces:
+                print(f"  {run_dir}: sem packets.bin (rode com --packetTrace)", file=sys.stderr)
+                continue
+            for i, (name, dscp) in enumerate(flow_info):
+                if i < flows.size and flows.tx_packets[i] + flows.rx_packets[i] > 0:
+                    flow_writer.writerow([run_dir, i + 1, name, name.rsplit("/", 1)[-1], dscp] + flows.metrics(i))
+            active = [i for i in range(nodes.size) if nodes.tx_packets[i] + nodes.rx_packets[i] > 0]
+            for i in active:
+                node_writer.writerow([run_dir, i] + nodes.metrics(i))
+            run_writer.writerow([run_dir, len(flow_info), len(active)] + (total.metrics(0) if total.size else [0] * len(METRICS)))
+            summarized += 1
+    print(f"{summarized} execuções resumidas em {out} (flow_summary.csv, node_summary.csv, run_summary.csv)")
+    return 0 if summarized else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,221 @@
+// Código comum aos dois cenários (sixlowpan_mqtt_simulation e video_streaming_qos) para medir a
+// latência por pacote e gravar o packets.bin lido pelo sweep/packet_summary.py: o histograma de
+// latência, a tag com o instante de envio e o escritor do formato colunar. Os dois programas
+// incluem este arquivo (o docker-compose de cada cenário monta o sweep/ em /ns-3-dev/sweep), para
+// que o formato tenha um único escritor; qualquer mudança de layout deve incrementar
+// PACKET_TRACE_VERSION aqui e no packet_summary.py.
+#ifndef PACKET_TRACE_H
+#define PACKET_TRACE_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Histograma de latência com baldes logarítmicos (estilo HDR): 16 sub-baldes por potência de 2,
+// ou seja, erro relativo de no máximo 1/16, com no máximo ~1000 contadores por histograma.
+class LatencyHistogram {
+public:
+    static const uint32_t SUB_BUCKET_BITS = 4;
+
+    // Índice do balde de um valor (ns).
+    static uint32_t BucketIndex(uint64_t value) {
+        if (value < (1u << SUB_BUCKET_BITS)) {
+            return static_cast<uint32_t>(value);
+        }
+        uint32_t shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+        return (shift << SUB_BUCKET_BITS) + static_cast<uint32_t>(value >> shift);
+    }
+    // Menor valor do balde index.
+    static uint64_t BucketLow(uint32_t index) {
+        if (index < (2u << SUB_BUCKET_BITS)) {
+            return index;
+        }
+        uint32_t shift = (index >> SUB_BUCKET_BITS) - 1;
+        return static_cast<uint64_t>(index - (shift << SUB_BUCKET_BITS)) << shift;
+    }
+    // Primeiro valor após o balde index.
+    static uint64_t BucketHigh(uint32_t index) { return BucketLow(index + 1); }
+
+    // Registra uma latência e atualiza o jitter (variação entre latências consecutivas).
+    void Record(int64_t latencyNs) {
+        uint64_t value = latencyNs > 0 ? static_cast<uint64_t>(latencyNs) : 0;
+        uint32_t index = BucketIndex(value);
+        if (index >= m_buckets.size()) {
+            m_buckets.resize(index + 1, 0);
+        }
+        m_buckets[index]++;
+        if (m_count > 0) {
+            m_jitterSumNs += std::abs(static_cast<double>(value) - static_cast<double>(m_lastNs));
+        }
+        m_count++;
+        m_sumNs += value;
+        m_maxNs = std::max(m_maxNs, value);
+        m_lastNs = value;
+    }
+    uint64_t GetCount() const { return m_count; }
+    double GetMeanNs() const { return m_count ? m_sumNs / m_count : 0.0; }
+    uint64_t GetMaxNs() const { return m_maxNs; }
+    // Média do módulo da diferença entre latências consecutivas.
+    double GetJitterNs() const { return m_count > 1 ? m_jitterSumNs / (m_count - 1) : 0.0; }
+    // Percentil p (0-100), aproximado pelo maior valor do balde correspondente.
+    uint64_t GetPercentileNs(double p) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * m_count)));
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < m_buckets.size(); ++i) {
+            seen += m_buckets[i];
+            if (seen >= rank) {
+                return std::min(BucketHigh(i) - 1, m_maxNs);
+            }
+        }
+        return m_maxNs;
+    }
+    const std::vector<uint32_t>& GetBuckets() const { return m_buckets; }
+private:
+    std::vector<uint32_t> m_buckets;
+    uint64_t m_count = 0;
+    double m_sumNs = 0.0;
+    uint64_t m_maxNs = 0;
+    uint64_t m_lastNs = 0;
+    double m_jitterSumNs = 0.0;
+};
+
+// Byte tag com o instante e o nó de origem de um pacote, adicionada na saída da camada IP
+// (IPv6 no cenário IoT, IPv4 no de QoS).
+class LatencyTag : public ns3::Tag {
+public:
+    static ns3::TypeId GetTypeId();
+    ns3::TypeId GetInstanceTypeId() const override { return GetTypeId(); }
+    uint32_t GetSerializedSize() const override { return 12; }
+    void Serialize(ns3::TagBuffer i) const override {
+        i.WriteU64(static_cast<uint64_t>(m_time.GetTimeStep()));
+        i.WriteU32(m_nodeId);
+    }
+    void Deserialize(ns3::TagBuffer i) override {
+        m_time = ns3::TimeStep(i.ReadU64());
+        m_nodeId = i.ReadU32();
+    }
+    void Print(std::ostream& os) const override { os << "SentAt=" << m_time << " Node=" << m_nodeId; }
+    void Set(ns3::Time time, uint32_t nodeId) {
+        m_time = time;
+        m_nodeId = nodeId;
+    }
+    ns3::Time GetTime() const { return m_time; }
+    uint32_t GetNodeId() const { return m_nodeId; }
+private:
+    ns3::Time m_time;
+    uint32_t m_nodeId = 0;
+};
+
+inline ns3::TypeId LatencyTag::GetTypeId() {
+    static ns3::TypeId tid = ns3::TypeId("LatencyTag").SetParent<ns3::Tag>().AddConstructor<LatencyTag>();
+    return tid;
+}
+
+NS_OBJECT_ENSURE_REGISTERED(LatencyTag);
+
+// Cabeçalho do packets.bin. O arquivo é uma sequência de blocos: um PacketBlockHeader seguido das
+// colunas dos seus registros (vetores de instante, atraso, fluxo, nó e bytes, nessa ordem), para
+// que a leitura carregue uma coluna inteira do bloco de uma vez. Registro com atraso negativo é um
+// envio; os demais são entregas. Tudo em little-endian, sem preenchimento entre os campos.
+struct PacketTraceHeader {
+    char magic[8];  // "PKTTRACE"
+    uint32_t version;
+    uint32_t blockRecords;  // Maior bloco do arquivo.
+};
+struct PacketBlockHeader {
+    uint32_t records;
+    uint32_t reserved;
+};
+static const uint32_t PACKET_TRACE_VERSION = 1;
+static_assert(sizeof(PacketTraceHeader) == 16, "PacketTraceHeader deve ter 16 bytes (HEADER do packet_summary.py)");
+static_assert(sizeof(PacketBlockHeader) == 8, "PacketBlockHeader deve ter 8 bytes (BLOCK do packet_summary.py)");
+
+// Acumula um bloco do packets.bin coluna a coluna e o grava no fim do arquivo quando enche.
+class PacketTrace {
+public:
+    ~PacketTrace() { Close(); }
+    // Abre o arquivo e grava o cabeçalho; falso se não puder ser criado.
+    bool Open(const std::string& path, uint32_t blockRecords);
+    void Append(int64_t timeNs, int64_t delayNs, uint32_t flow, uint32_t node, uint32_t bytes) {
+        m_time.push_back(timeNs);
+        m_delay.push_back(delayNs);
+        m_flow.push_back(flow);
+        m_node.push_back(node);
+        m_bytes.push_back(bytes);
+        if (m_time.size() == m_blockRecords) {
+            WriteBlock();
+        }
+    }
+    // Grava o bloco parcial e fecha o arquivo.
+    void Close();
+    bool IsOpen() const { return m_file != nullptr; }
+    uint64_t GetRecordCount() const { return m_records; }
+private:
+    void WriteBlock();
+
+    std::FILE* m_file = nullptr;
+    uint32_t m_blockRecords = 0;
+    // Colunas do bloco atual, na ordem do arquivo.
+    std::vector<int64_t> m_time;  // ns
+    std::vector<int64_t> m_delay;  // ns; -1 nos envios.
+    std::vector<uint32_t> m_flow;  // Índice no packet_flows.csv.
+    std::vector<uint32_t> m_node;  // Nó de origem.
+    std::vector<uint32_t> m_bytes;  // Incluindo o cabeçalho IP.
+    uint64_t m_records = 0;
+};
+
+inline bool PacketTrace::Open(const std::string& path, uint32_t blockRecords) {
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+    m_blockRecords = std::max<uint32_t>(blockRecords, 1);
+    PacketTraceHeader header;
+    std::memcpy(header.magic, "PKTTRACE", sizeof(header.magic));
+    header.version = PACKET_TRACE_VERSION;
+    header.blockRecords = m_blockRecords;
+    std::fwrite(&header, sizeof(header), 1, m_file);
+    for (auto* column : {&m_time, &m_delay}) {
+        column->reserve(m_blockRecords);
+    }
+    for (auto* column : {&m_flow, &m_node, &m_bytes}) {
+        column->reserve(m_blockRecords);
+    }
+    return true;
+}
+
+inline void PacketTrace::WriteBlock() {
+    PacketBlockHeader block{static_cast<uint32_t>(m_time.size()), 0};
+    std::fwrite(&block, sizeof(block), 1, m_file);
+    for (auto* column : {&m_time, &m_delay}) {
+        std::fwrite(column->data(), sizeof(int64_t), column->size(), m_file);
+        column->clear();
+    }
+    for (auto* column : {&m_flow, &m_node, &m_bytes}) {
+        std::fwrite(column->data(), sizeof(uint32_t), column->size(), m_file);
+        column->clear();
+    }
+    m_records += block.records;
+}
+
+inline void PacketTrace::Close() {
+    if (!m_file) {
+        return;
+    }
+    if (!m_time.empty()) {
+        WriteBlock();
+    }
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+#endif // PACKET_TRACE_H
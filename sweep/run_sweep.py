@@ -0,0 +1,297 @@
+#!/usr/bin/env python3
+# Executa varreduras de parâmetros (parameter sweeps) dos cenários ns-3 em paralelo
+# e junta os resultados de todas as execuções em um único banco SQLite.
+#
+# Exemplo (dentro do container, em /ns-3-dev):
+#   python3 sweep/run_sweep.py iot --param nSensors=10,50,100 --param maxPackets=10,20 \
+#       --runs 30 --out output/sweeps/iot --db output/sweeps/results.db
+#   python3 sweep/run_sweep.py qos --param queueSize=20p,50p,100p \
+#       --param qdisc=fqcodel,prio,drr --runs 50
+#
+# Cada combinação de parâmetros (ponto) é executada com RngRun = first_run .. first_run+runs-1,
+# e cada execução grava suas saídas em <out>/point-XXXX/run-YYYY (passado via --outputDir).
+
+import argparse
+import concurrent.futures
+import csv
+import itertools
+import json
+import os
+import sqlite3
+import struct
+import subprocess
+import sys
+import time
+
+# Programas de cada cenário (relativos ao diretório do ns-3).
+SCENARIOS = {
+    "iot": "scratch/sixlowpan_mqtt_simulation",
+    "qos": "scratch/video_streaming_qos",
+}
+
+
+# Converte "nome=v1,v2,v3" em ("nome", ["v1", "v2", "v3"]).
+def parse_param(text):
+    if "=" not in text:
+        raise argparse.ArgumentTypeError(f"parâmetro inválido '{text}', use nome=v1,v2,...")
+    name, values = text.split("=", 1)
+    return name, [v for v in values.split(",") if v != ""]
+
+
+# Compila o programa uma vez e descobre o caminho do executável, para não chamar ./ns3 run
+# a cada execução (o ./ns3 verifica o build a cada chamada e serializa execuções paralelas).
+def resolve_executable(ns3_dir, program):
+    result = subprocess.run(["./ns3", "run", program, "--command-template=echo %s"],
+                            cwd=ns3_dir, check=True, capture_output=True, text=True)
+    return result.stdout.strip().splitlines()[-1].strip()
+
+
+# Executa uma simulação e retorna (job, código de saída, tempo de relógio).
+def run_job(executable, ns3_dir, job):
+    os.makedirs(job["outdir"], exist_ok=True)
+    args = [executable, f"--RngRun={job['rng_run']}", f"--outputDir={job['outdir']}"]
+    args += [f"--{name}={value}" for name, value in job["params"].items()]
+    env = dict(os.environ)
+    env["LD_LIBRARY_PATH"] = os.path.join(ns3_dir, "build", "lib") + ":" + env.get("LD_LIBRARY_PATH", "")
+    start = time.monotonic()
+    with open(os.path.join(job["outdir"], "stdout.txt"), "w") as out:
+        code = subprocess.run(args, cwd=ns3_dir, env=env, stdout=out, stderr=subprocess.STDOUT).returncode
+    return job, code, time.monotonic() - start
+
+
+# Cria as tabelas do banco de resultados (se ainda não existirem).
+def init_db(db, param_names):
+    db.execute("""CREATE TABLE IF NOT EXISTS runs (
+                      run_id INTEGER PRIMARY KEY AUTOINCREMENT,
+                      sweep TEXT, scenario TEXT, point_id INTEGER, rng_run INTEGER,
+                      params TEXT, status INTEGER, wall_time REAL, outdir TEXT)""")
+    # Cada parâmetro da varredura também vira uma coluna de runs, para filtrar/agrupar direto no pandas.
+    existing = {row[1] for row in db.execute("PRAGMA table_info(runs)")}
+    for name in param_names:
+        if name not in existing:
+            db.execute(f'ALTER TABLE runs ADD COLUMN "{name}" TEXT')
+    db.execute("CREATE TABLE IF NOT EXISTS iot_latency (run_id INTEGER, flow_index INTEGER, latency REAL)")
+    db.execute("CREATE TABLE IF NOT EXISTS iot_nodes (run_id INTEGER, node_index INTEGER, messages_sent REAL, energy REAL)")
+    db.execute("""CREATE TABLE IF NOT EXISTS iot_energy (
+                      run_id INTEGER, NodeID INTEGER, "Off(s)" REAL, "Idle(s)" REAL, "Rx(s)" REAL, "Tx(s)" REAL,
+                      "Off(J)" REAL, "Idle(J)" REAL, "Rx(J)" REAL, "Tx(J)" REAL, "Total(J)" REAL,
+                      "AvgPower(mW)" REAL, LifetimeDays REAL, "DepletedAt(s)" REAL)""")
+    db.execute("CREATE TABLE IF NOT EXISTS iot_events (run_id INTEGER, Timestamp REAL, NodeID INTEGER, Event TEXT, Details TEXT)")
+    db.execute("""CREATE TABLE IF NOT EXISTS iot_run_stats (
+                      run_id INTEGER, Sensors INTEGER, Gateways INTEGER, Nodes INTEGER, SimSeconds REAL,
+                      WallSeconds REAL, SimPerWall REAL, Events INTEGER, EventsPerSecond REAL, BuildRssKb INTEGER,
+                      PeakRssKb INTEGER, StartupSeconds REAL, TxPackets INTEGER, RxPackets INTEGER,
+                      DeliveryRatio REAL, "MeanDelay(ms)" REAL, "P99Delay(ms)" REAL)""")
+    db.execute("""CREATE TABLE IF NOT EXISTS qos_flows (
+                      run_id INTEGER, FlowID INTEGER, SourceIP TEXT, SourcePort INTEGER,
+                      DestinationIP TEXT, DestinationPort INTEGER, Protocol TEXT,
+                      "Throughput(Mbps)" REAL, "AvgDelay(ms)" REAL, "PacketLossRate(%)" REAL, DSCP INTEGER,
+                      "Jitter(ms)" REAL)""")
+    # Bancos criados antes da coluna de jitter.
+    if "Jitter(ms)" not in {row[1] for row in db.execute("PRAGMA table_info(qos_flows)")}:
+        db.execute('ALTER TABLE qos_flows ADD COLUMN "Jitter(ms)" REAL')
+    db.execute("""CREATE TABLE IF NOT EXISTS qos_qoe (
+                      run_id INTEGER, Client INTEGER, Mode TEXT, Abr TEXT, Segments INTEGER, "StartupDelay(s)" REAL,
+                      Rebuffers INTEGER, "StallTime(s)" REAL, RebufferRatio REAL, Switches INTEGER,
+                      "AvgBitrate(Mbps)" REAL, LossRate REAL)""")
+    db.execute("""CREATE TABLE IF NOT EXISTS qos_run_stats (
+                      run_id INTEGER, Clients INTEGER, Routers INTEGER, Nodes INTEGER, Flows INTEGER,
+                      SimSeconds REAL, WallSeconds REAL, SimPerWall REAL, Events INTEGER, EventsPerSecond REAL,
+                      BuildRssKb INTEGER, PeakRssKb INTEGER, Ranks INTEGER, StartupSeconds REAL,
+                      TxPackets INTEGER, RxPackets INTEGER, DeliveryRatio REAL, "MeanDelay(ms)" REAL,
+                      "P99Delay(ms)" REAL)""")
+    # Bancos criados antes das colunas Ranks, StartupSeconds e dos KPIs da execução.
+    run_stats_columns = {row[1] for row in db.execute("PRAGMA table_info(qos_run_stats)")}
+    for name, kind in (("Ranks", "INTEGER"), ("StartupSeconds", "REAL"), ("TxPackets", "INTEGER"),
+                       ("RxPackets", "INTEGER"), ("DeliveryRatio", "REAL"), ("MeanDelay(ms)", "REAL"),
+                       ("P99Delay(ms)", "REAL")):
+        if name not in run_stats_columns:
+            db.execute(f'ALTER TABLE qos_run_stats ADD COLUMN "{name}" {kind}')
+    db.execute("CREATE TABLE IF NOT EXISTS qos_tcp_flows (run_id INTEGER, Client INTEGER, SourceIP TEXT, CongestionControl TEXT, Ecn TEXT)")
+    db.execute("""CREATE TABLE IF NOT EXISTS qos_queue (
+                      run_id INTEGER, Time REAL, Device INTEGER, Name TEXT, Packets INTEGER, Bytes INTEGER,
+                      MaxPackets INTEGER, Enqueued INTEGER, Drops INTEGER, Marks INTEGER, "MeanSojourn(ms)" REAL,
+                      "MaxSojourn(ms)" REAL, Utilization REAL)""")
+    db.execute("""CREATE TABLE IF NOT EXISTS latency_percentiles (
+                      run_id INTEGER, Scope TEXT, Key TEXT, Count INTEGER, "Mean(ms)" REAL, "P50(ms)" REAL,
+                      "P90(ms)" REAL, "P99(ms)" REAL, "P99.9(ms)" REAL, "Max(ms)" REAL, "Jitter(ms)" REAL)""")
+
+
+# Lê um arquivo com um número por linha (formato dos .txt do cenário IoT).
+def read_column(path):
+    if not os.path.exists(path):
+        return []
+    with open(path) as f:
+        return [float(line) for line in f if line.strip()]
+
+
+# Importa as saídas de uma execução do cenário IoT.
+def ingest_iot(db, run_id, outdir, with_events):
+    latencies = read_column(os.path.join(outdir, "latency.txt"))
+    db.executemany("INSERT INTO iot_latency VALUES (?, ?, ?)",
+                   [(run_id, i, v) for i, v in enumerate(latencies)])
+    sent = read_column(os.path.join(outdir, "messages_sent.txt"))
+    energy = read_column(os.path.join(outdir, "energy_consumption.txt"))
+    db.executemany("INSERT INTO iot_nodes VALUES (?, ?, ?, ?)",
+                   [(run_id, i, s, e) for i, (s, e) in enumerate(zip(sent, energy))])
+    states = os.path.join(outdir, "energy_states.csv")
+    if os.path.exists(states):
+        with open(states, newline="") as f:
+            reader = csv.reader(f)
+            next(reader, None)  # Cabeçalho.
+            db.executemany(f"INSERT INTO iot_energy VALUES ({', '.join('?' * 15)})", ((run_id, *row) for row in reader))
+    stats = os.path.join(outdir, "run_stats.csv")
+    if os.path.exists(stats):
+        with open(stats, newline="") as f:
+            reader = csv.reader(f)
+            next(reader, None)  # Cabeçalho.
+            db.executemany(f"INSERT INTO iot_run_stats VALUES ({', '.join('?' * 17)})", ((run_id, *row) for row in reader))
+    logs = os.path.join(outdir, "logs.csv")
+    if with_events and os.path.exists(logs):
+        with open(logs, newline="") as f:
+            reader = csv.DictReader(f)
+            db.executemany("INSERT INTO iot_events VALUES (?, ?, ?, ?, ?)",
+                           ((run_id, float(r["Timestamp"]), int(r["NodeID"]), r["Event"], r["Details"]) for r in reader))
+
+
+# Registro do queue_stats.bin (QueueSampleRecord): tempo, dispositivo, 6 contadores e 3 floats.
+QUEUE_RECORD = struct.Struct("<dHHIIIIIIfff")
+
+
+# Importa a série temporal das filas direto do queue_stats.bin (cabeçalho de 16 bytes + registros).
+def ingest_queue_stats(db, run_id, outdir):
+    path = os.path.join(outdir, "queue_stats.bin")
+    names_path = os.path.join(outdir, "queue_devices.csv")
+    if not os.path.exists(path) or not os.path.exists(names_path):
+        return
+    with open(names_path, newline="") as f:
+        names = {int(r["Device"]): r["Name"] for r in csv.DictReader(f)}
+    with open(path, "rb") as f:
+        magic, version, size = struct.unpack("<8sII", f.read(16))
+        if magic != b"VSQSTATS" or version != 1 or size != QUEUE_RECORD.size:
+            print(f"  {path}: formato desconhecido", file=sys.stderr)
+            return
+        data = f.read()
+    data = data[:len(data) - len(data) % QUEUE_RECORD.size]
+    db.executemany(f"INSERT INTO qos_queue VALUES ({', '.join('?' * 13)})",
+                   ((run_id, t, d, names.get(d, ""), *rest) for t, d, _, *rest in QUEUE_RECORD.iter_unpack(data)))
+
+
+# Importa as saídas de uma execução do cenário de QoS.
+def ingest_qos(db, run_id, outdir, with_events):
+    path = os.path.join(outdir, "simulation_results.csv")
+    if not os.path.exists(path):
+        return
+    with open(path, newline="") as f:
+        reader = csv.reader(f)
+        next(reader, None)  # Cabeçalho.
+        db.executemany("INSERT INTO qos_flows VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                       ((run_id, *row) for row in reader))
+    # QoE dos players, só nos modos dash/rtp.
+    qoe = os.path.join(outdir, "video_qoe.csv")
+    if os.path.exists(qoe):
+        with open(qoe, newline="") as f:
+            reader = csv.reader(f)
+            next(reader, None)  # Cabeçalho.
+            db.executemany(f"INSERT INTO qos_qoe VALUES ({', '.join('?' * 12)})", ((run_id, *row) for row in reader))
+    stats = os.path.join(outdir, "run_stats.csv")
+    if os.path.exists(stats):
+        with open(stats, newline="") as f:
+            reader = csv.reader(f)
+            next(reader, None)  # Cabeçalho.
+            db.executemany(f"INSERT INTO qos_run_stats VALUES ({', '.join('?' * 19)})", ((run_id, *row) for row in reader))
+    tcp_flows = os.path.join(outdir, "tcp_flows.csv")
+    if os.path.exists(tcp_flows):
+        with open(tcp_flows, newline="") as f:
+            reader = csv.reader(f)
+            next(reader, None)  # Cabeçalho.
+            db.executemany("INSERT INTO qos_tcp_flows VALUES (?, ?, ?, ?, ?)", ((run_id, *row) for row in reader))
+    # A série das filas pode ser grande; só é importada com --with-events.
+    if with_events:
+        ingest_queue_stats(db, run_id, outdir)
+
+
+# Importa o último snapshot do latency_percentiles.csv (percentis acumulados da execução inteira).
+def ingest_latency_percentiles(db, run_id, outdir):
+    path = os.path.join(outdir, "latency_percentiles.csv")
+    if not os.path.exists(path):
+        return
+    with open(path, newline="") as f:
+        rows = list(csv.reader(f))[1:]
+    if not rows:
+        return
+    last = max(float(r[0]) for r in rows)
+    db.executemany("INSERT INTO latency_percentiles VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                   ((run_id, *r[1:]) for r in rows if float(r[0]) == last))
+
+
+INGEST = {"iot": ingest_iot, "qos": ingest_qos}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Varredura paralela de parâmetros dos cenários ns-3")
+    parser.add_argument("scenario", choices=sorted(SCENARIOS))
+    parser.add_argument("--param", action="append", type=parse_param, default=[],
+                        help="parâmetro da simulação e seus valores: nome=v1,v2,... (pode repetir)")
+    parser.add_argument("--runs", type=int, default=10, help="execuções (sementes) por ponto")
+    parser.add_argument("--first-run", type=int, default=1, help="primeiro valor de RngRun")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count(), help="execuções simultâneas")
+    parser.add_argument("--ns3-dir", default="/ns-3-dev")
+    parser.add_argument("--out", default=None, help="diretório raiz das execuções")
+    parser.add_argument("--db", default=None, help="banco SQLite onde os resultados são juntados")
+    parser.add_argument("--name", default=None, help="nome da varredura (padrão: cenário + horário)")
+    parser.add_argument("--with-events", action="store_true",
+                        help="importa também o logs.csv do cenário IoT e o queue_stats.bin do cenário de QoS")
+    args = parser.parse_args()
+
+    name = args.name or time.strftime(f"{args.scenario}-%Y%m%d-%H%M%S")
+    out = os.path.abspath(args.out or os.path.join(args.ns3_dir, "output", "sweeps", name))
+    db_path = os.path.abspath(args.db or os.path.join(args.ns3_dir, "output", "sweeps", "results.db"))
+    os.makedirs(out, exist_ok=True)
+    os.makedirs(os.path.dirname(db_path), exist_ok=True)
+
+    # Produto cartesiano dos valores de cada parâmetro.
+    names = [n for n, _ in args.param]
+    points = [dict(zip(names, values)) for values in itertools.product(*[v for _, v in args.param])]
+    jobs = []
+    for point_id, params in enumerate(points):
+        for k in range(args.runs):
+            rng_run = args.first_run + k
+            outdir = os.path.join(out, f"point-{point_id:04d}", f"run-{rng_run:04d}")
+            jobs.append({"point_id": point_id, "params": params, "rng_run": rng_run, "outdir": outdir})
+    with open(os.path.join(out, "points.json"), "w") as f:
+        json.dump(points, f, indent=2)
+
+    executable = resolve_executable(args.ns3_dir, SCENARIOS[args.scenario])
+    print(f"{name}: {len(points)} pontos x {args.runs} execuções = {len(jobs)} jobs em {args.jobs} processos")
+
+    db = sqlite3.connect(db_path)
+    init_db(db, names)
+    failures = 0
+    start = time.monotonic()
+    # As simulações rodam em processos separados; as threads apenas aguardam os subprocessos.
+    # A importação no SQLite acontece aqui, em uma única thread, à medida que as execuções terminam.
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [pool.submit(run_job, executable, args.ns3_dir, job) for job in jobs]
+        for done, future in enumerate(concurrent.futures.as_completed(futures), 1):
+            job, code, wall = future.result()
+            columns = ["sweep", "scenario", "point_id", "rng_run", "params", "status", "wall_time", "outdir"] + names
+            values = [name, args.scenario, job["point_id"], job["rng_run"], json.dumps(job["params"]),
+                      code, wall, job["outdir"]] + [job["params"][n] for n in names]
+            quoted = ", ".join(f'"{c}"' for c in columns)
+            cursor = db.execute(f"INSERT INTO runs ({quoted}) VALUES ({', '.join('?' * len(columns))})", values)
+            if code == 0:
+                INGEST[args.scenario](db, cursor.lastrowid, job["outdir"], args.with_events)
+                ingest_latency_percentiles(db, cursor.lastrowid, job["outdir"])
+            else:
+                failures += 1
+                print(f"  falha (código {code}): {job['outdir']}", file=sys.stderr)
+            db.commit()
+            print(f"  [{done}/{len(jobs)}] ponto {job['point_id']} RngRun {job['rng_run']}: {wall:.1f}s")
+    db.close()
+    print(f"Concluído em {time.monotonic() - start:.1f}s, {failures} falhas. Resultados em {db_path}")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
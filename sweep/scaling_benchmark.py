@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Benchmark de escala do cenário de QoS: roda o video_streaming_qos com número crescente de
+# clientes, uma execução por vez (para que o pico de RSS e o tempo de relógio de uma não
+# interfiram na outra), e reporta segundos simulados por segundo de relógio e pico de RSS.
+# Com --ranks, cada tamanho também roda distribuído (mpirun -np K ... --distributed) e o
+# speedup é o tempo de relógio da execução sequencial (K = 1) sobre o da distribuída.
+#
+# Exemplo (dentro do container, em /ns-3-dev):
+#   python3 sweep/scaling_benchmark.py --clients 10,50,100,200,500 --routers 2 -- --duration=20
+#   python3 sweep/scaling_benchmark.py --clients 1000,4000 --ranks 1,2,4 -- --duration=10
+#
+# Argumentos depois de "--" são repassados à simulação.
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import time
+
+from run_sweep import SCENARIOS, resolve_executable
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark de escala do cenário de QoS")
+    parser.add_argument("--clients", default="2,10,50,100,200", help="valores de nClients, separados por vírgula")
+    parser.add_argument("--routers", type=int, default=2, help="nRouters de todas as execuções")
+    parser.add_argument("--topology", default="dumbbell", choices=["dumbbell", "tree"])
+    parser.add_argument("--ranks", default="1", help="processos MPI de cada tamanho, separados por vírgula (1 = sequencial)")
+    parser.add_argument("--mpirun", default="mpirun --allow-run-as-root", help="comando do mpirun")
+    parser.add_argument("--ns3-dir", default="/ns-3-dev")
+    parser.add_argument("--out", default=None, help="diretório das execuções (padrão: output/scaling)")
+    parser.add_argument("extra", nargs="*", help="argumentos repassados à simulação (depois de --)")
+    args = parser.parse_args()
+
+    out = os.path.abspath(args.out or os.path.join(args.ns3_dir, "output", "scaling"))
+    os.makedirs(out, exist_ok=True)
+    executable = resolve_executable(args.ns3_dir, SCENARIOS["qos"])
+    env = dict(os.environ)
+    env["LD_LIBRARY_PATH"] = os.path.join(args.ns3_dir, "build", "lib") + ":" + env.get("LD_LIBRARY_PATH", "")
+
+    rows = []
+    print(f"{'Clientes':>8} {'Ranks':>5} {'Nós':>6} {'Fluxos':>6} {'Relógio(s)':>10} {'Sim/relógio':>11} "
+          f"{'Eventos/s':>10} {'Pico RSS(MB)':>12} {'Speedup':>7}")
+    ranks = [int(v) for v in args.ranks.split(",") if v]
+    for n in [int(v) for v in args.clients.split(",") if v]:
+        sequential = None
+        for k in ranks:
+            outdir = os.path.join(out, f"clients-{n:05d}-ranks-{k:03d}")
+            os.makedirs(outdir, exist_ok=True)
+            cmd = [executable, f"--nClients={n}", f"--nRouters={args.routers}", f"--topology={args.topology}",
+                   f"--outputDir={outdir}", "--latencyInterval=0"] + args.extra
+            if k > 1:
+                cmd = args.mpirun.split() + ["-np", str(k)] + cmd + ["--distributed=1"]
+            start = time.monotonic()
+            with open(os.path.join(outdir, "stdout.txt"), "w") as log:
+                code = subprocess.run(cmd, cwd=args.ns3_dir, env=env, stdout=log, stderr=subprocess.STDOUT).returncode
+            if code != 0:
+                print(f"  falha com {n} clientes e {k} ranks (código {code}, {time.monotonic() - start:.1f}s), "
+                      f"veja {outdir}/stdout.txt", file=sys.stderr)
+                continue
+            with open(os.path.join(outdir, "run_stats.csv"), newline="") as f:
+                stats = next(csv.DictReader(f))
+            wall = float(stats["WallSeconds"])
+            if k == 1:
+                sequential = wall
+            stats["Speedup"] = f"{sequential / wall:.3f}" if sequential and wall > 0 else ""
+            rows.append(stats)
+            print(f"{n:>8} {k:>5} {stats['Nodes']:>6} {stats['Flows']:>6} {wall:>10.2f} "
+                  f"{float(stats['SimPerWall']):>11.3f} {float(stats['EventsPerSecond']):>10.0f} "
+                  f"{int(stats['PeakRssKb']) / 1024:>12.1f} {stats['Speedup']:>7}")
+
+    if rows:
+        with open(os.path.join(out, "scaling.csv"), "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(rows[0].keys()))
+            writer.writeheader()
+            writer.writerows(rows)
+        print(f"Resultados em {os.path.join(out, 'scaling.csv')}")
+    return 0 if rows else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())